@@ -56,7 +56,7 @@ void chsm_compiler::backpatch_enter_exit_events() {
   for ( auto const &sy_event : CHSM->events_ ) {
     event_info const &info = *INFO_CONST( event, sy_event );
     symbol const *const sy_state = info.sy_state_;
-    if ( sy_state == nullptr )
+    if ( sy_state == nullptr || info.kind_ == event_info::KIND_AFTER )
       continue;
     if ( info.kind_ == event_info::KIND_USER ) {
       cc_fatal() << "data error in backpatch_enter_exit_events()" << endl;
@@ -136,9 +136,7 @@ void chsm_compiler::check_transitions() {
       // common part of both names -- this is the name of the least-common-
       // ancestor state -- and see if it's a set.
       //
-      char name[ 256 ];
-      ::strcpy( name, from0 );
-      name[ from - from0 - 1 ] = '\0';
+      string const name( from0, from - from0 - 1 );
       symbol const &sy_ancestor = sym_table_[ name ];
       if ( (type_of( sy_ancestor ) & TYPE(SET)) != TYPE(NONE) )
         source_->error( info.first_ref_ ) << "intra-set transition\n";
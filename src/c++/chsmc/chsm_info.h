@@ -53,6 +53,7 @@ struct chsm_info final : global_info, param_data {
   typedef symbol_list transition_list;
 
   static char const PREFIX_ACTION[];    ///< Prefix for actions.
+  static char const PREFIX_AFTER[];     ///< Prefix for timeout events.
   static char const PREFIX_CONDITION[]; ///< Prefix for conditions.
   static char const PREFIX_ENTER[];     ///< Prefix for enter events.
   static char const PREFIX_EXIT[];      ///< Prefix for exit events.
@@ -64,14 +65,15 @@ struct chsm_info final : global_info, param_data {
 
   //
   // Sequence numbers used for compiler-generated function names for
-  // conditions and actions.
+  // conditions and actions (and event names for timeouts).
   //
   struct id {
     id_type condition_;
     id_type target_;
     id_type action_;
+    id_type after_;
 
-    id() : condition_{ 0 }, target_{ 0 }, action_{ 0 } { }
+    id() : condition_{ 0 }, target_{ 0 }, action_{ 0 }, after_{ 0 } { }
   };
 
   id id_;
@@ -37,6 +37,7 @@
 
 // standard
 #include <functional>
+#include <vector>
 
 using namespace std;
 using namespace PJL;
@@ -56,8 +57,7 @@ private:
   void emit_common( state_info const &si );
   void emit_common( event_info const &si );
 
-  void emit_common( parent_info const &si,
-                    char const *formal_params = nullptr );
+  void emit_common( parent_info const &si );
 
   void emit() final;
   void visit( chsm_info const& ) final;
@@ -114,13 +114,29 @@ public:
   cpp_initializer initializer_;
 
 private:
+  size_t path_offset_;                  ///< Offset of next path in paths_[].
+  size_t child_offset_;                 ///< Offset of next in children_[].
+
   void emit_chsm();
 
   void emit_common( event_info const &si );
 
-  void emit_common( parent_info const &si,
-                    char const *formal_params = nullptr,
-                    char const *actual_params = nullptr );
+  void emit_common( parent_info const &si );
+
+  /**
+   * Emits the descriptors of all the states and their child state lists.
+   */
+  void emit_descriptors();
+
+  /**
+   * Emits the dispatch table for an event's transitions.
+   *
+   * @param si The event to emit the dispatch table for.
+   * @param transition_ids The IDs of all the transitions the event can
+   * trigger.
+   */
+  void emit_dispatch( event_info const &si,
+                      event_info::transition_id_list const &transition_ids );
 
   void emit_events();
   void emit_states();
@@ -140,11 +156,18 @@ private:
 
 } // namespace
 
+static char const BASES_SUFFIX[]        = "_bases";
 static char const CHSM_NS_ALIAS[]       = "CHSM_ns_alias";
+static char const DELAY_SUFFIX[]        = "_delay";
+static char const DESCRIPTOR_SUFFIX[]   = "_descriptor";
+static char const DISPATCH_SUFFIX[]     = "_dispatch";
 static char const EVENT_CLASS_SUFFIX[]  = "_event";
 static char const PARENT_CLASS_PREFIX[] = "state_";
+static char const SOURCES_SUFFIX[]      = "_sources";
 static char const TRANSITIONS_SUFFIX[]  = "_transitions";
 
+static unsigned const CONFIG_WORD_BITS  = 64;
+
 ///////////////////////////////////////////////////////////////////////////////
 
 /**
@@ -165,8 +188,11 @@ static ostream_manip lib_class_name( base_info const &bi ) {
       };
     }
     TYPE_CASE( ei, event_info const ) {
-      return []( ostream &o ) -> ostream& {
-        return o << CHSM_NS_ALIAS << "::event";
+      return [ei]( ostream &o ) -> ostream& {
+        if ( ei->kind_ == event_info::KIND_AFTER )
+          return o << CHSM_NS_ALIAS << "::timeout_event";
+        else
+          return o << CHSM_NS_ALIAS << "::event";
       };
     }
     TYPE_CASE( si, set_info const ) {
@@ -192,6 +218,85 @@ static ostream_manip lib_class_name( base_info const &bi ) {
   return nullptr;
 }
 
+/**
+ * Inserts the name of an event as a C++ string literal's characters.  The
+ * names of enter, exit, and timeout events are derived from their states.
+ *
+ * @param si The event_info to insert the name of.
+ * @return Returns an ostream manipulator that, when inserted into an ostream,
+ * inserts said name.
+ */
+static ostream_manip event_name( event_info const &si ) {
+  return [&si]( ostream &o ) -> ostream& {
+    symbol const *const sy = si.get_symbol();
+    switch ( si.kind_ ) {
+      case event_info::KIND_USER:
+        o << sy->name();
+        break;
+      case event_info::KIND_ENTER:
+      case event_info::KIND_EXIT:
+        o << (si.kind_ == event_info::KIND_ENTER ? "enter" : "exit")
+          << '(' << demangle( sy->name() + 1 ) << ')';
+        break;
+      case event_info::KIND_AFTER:
+        o << "after(" << si.sy_state_->name() << ", ";
+        for ( char const c : si.delay_ ) {
+          switch ( c ) {
+            case '"':
+            case '\\':
+              o << '\\' << c;
+              break;
+            case '\n':
+              o << ' ';
+              break;
+            default:
+              o << c;
+          } // switch
+        } // for
+        o << ')';
+        break;
+    } // switch
+    return o;
+  };
+}
+
+/**
+ * Gets the base events of an event.
+ *
+ * @param si The event_info of the event.
+ * @return Returns the symbols of its base events, outermost first.
+ */
+static vector<symbol const*> base_events( event_info const &si ) {
+  vector<symbol const*> bases;
+  if ( auto const ui = dynamic_cast<user_event_info const*>( &si ) ) {
+    for ( auto sy = ui->sy_base_event_; sy != nullptr;
+          sy = INFO_CONST( user_event, sy )->sy_base_event_ ) {
+      bases.insert( bases.begin(), sy );
+    } // for
+  }
+  return bases;
+}
+
+/**
+ * Gets all the transitions an event can trigger: its own followed by those of
+ * its base event, if any, followed by those of its base event, if any, and so
+ * on.  This is the order in which the run-time library used to walk them, but
+ * is now computed once here so it never has to.
+ *
+ * @param si The event_info of the event.
+ * @return Returns said transitions' IDs.
+ */
+static event_info::transition_id_list all_transition_ids(
+    event_info const &si ) {
+  event_info::transition_id_list ids( si.transition_ids_ );
+  vector<symbol const*> const bases( base_events( si ) );
+  for ( auto b = bases.rbegin(); b != bases.rend(); ++b ) {
+    auto const &base_ids = INFO_CONST( event, *b )->transition_ids_;
+    ids.insert( ids.end(), base_ids.begin(), base_ids.end() );
+  } // for
+  return ids;
+}
+
 static ostream_manip base_class_name( user_event_info const &si ) {
   return [&si]( ostream &o ) -> ostream& {
     if ( si.sy_base_event_ != nullptr )
@@ -203,6 +308,71 @@ static ostream_manip base_class_name( user_event_info const &si ) {
   };
 }
 
+/**
+ * Gets the number of words needed for a bitset of all the states of the CHSM.
+ *
+ * @return Returns said number.
+ */
+static size_t config_words() {
+  // degenerate case: no states; silly, but legal
+  return CHSM->states_.empty() ?
+    1 : (CHSM->states_.size() + CONFIG_WORD_BITS - 1) / CONFIG_WORD_BITS;
+}
+
+/**
+ * Computes the states a transition exits and enters, in order, so the
+ * run-time library needn't walk the state hierarchy each time the transition
+ * is taken.
+ *
+ * @param ti The transition to compute the paths of.
+ * @param exit_path The IDs of the ancestors of the "from" state to exit after
+ * it, innermost first.
+ * @param enter_path The IDs of the ancestors of the "to" state below the least
+ * common ancestor of it and the "from" state, outermost first, followed by the
+ * "to" state itself.
+ * @return Returns `true` only if the paths could be computed, i.e., only if
+ * the transition has a static "to" state.
+ */
+static bool transition_paths( transition_info const &ti,
+                              vector<int> &exit_path,
+                              vector<int> &enter_path ) {
+  exit_path.clear();
+  enter_path.clear();
+  if ( ti.sy_to_ == nullptr || ti.target_id_ > 0 )
+    return false;
+
+  auto const parent_of = []( symbol const *sy ) {
+    return INFO_CONST( state, sy )->sy_parent_;
+  };
+  auto const is_ancestor_of = [&]( symbol const *sy_a, symbol const *sy ) {
+    for ( sy = parent_of( sy ); sy != nullptr; sy = parent_of( sy ) )
+      if ( sy == sy_a )
+        return true;
+    return false;
+  };
+
+  //
+  // Exit the ancestors of the "from" state up to (but not including) the
+  // first one that is also an ancestor of the "to" state, i.e., their least
+  // common ancestor (or null for the root).
+  //
+  symbol const *sy_lca = parent_of( ti.sy_from_ );
+  for ( ; sy_lca != nullptr && !is_ancestor_of( sy_lca, ti.sy_to_ );
+        sy_lca = parent_of( sy_lca ) ) {
+    exit_path.push_back( ::serial( sy_lca ) );
+  } // for
+
+  //
+  // Enter the ancestors of the "to" state below their least common ancestor,
+  // outermost first, then the "to" state itself.
+  //
+  for ( auto sy = parent_of( ti.sy_to_ ); sy != sy_lca; sy = parent_of( sy ) )
+    enter_path.insert( enter_path.begin(), ::serial( sy ) );
+  enter_path.push_back( ::serial( ti.sy_to_ ) );
+
+  return true;
+}
+
 static ostream_manip class_name( user_event_info const &si ) {
   return [&si]( ostream &o ) -> ostream& {
     return o << si.get_symbol()->name() << EVENT_CLASS_SUFFIX;
@@ -250,8 +420,12 @@ void cpp_generator::emit_enter_exit_begin( char const *kind,
         << CHSM_NS_ALIAS << "::event const &event ) {\n"
         << indent << "(void)event;\n";  // suppresses unused warning
   emit_source_line_no( U_OUT );
+  //
+  // The action is called only for this state, so its class is known: there's
+  // no need to pay for a dynamic_cast on every enter/exit.
+  //
   U_OUT << indent << lib_class_name( info )
-        << " const &state = dynamic_cast<" << lib_class_name( info )
+        << " const &state = static_cast<" << lib_class_name( info )
         << " const&>(chsm_state_);\n"
         << indent << "(void)state;\n";  // suppresses unused warning
 }
@@ -410,11 +584,23 @@ void cpp_declarer::emit_common( event_info const &si ) {
         << indent << "static "
         << CHSM_NS_ALIAS << "::transition::id const "
         << sy->name() << TRANSITIONS_SUFFIX << "[];" T_ENDL
-        << "public:" T_ENDL;
+        << indent << "static "
+        << CHSM_NS_ALIAS << "::event::dispatch const "
+        << sy->name() << DISPATCH_SUFFIX << "[];" T_ENDL
+        << indent << "static "
+        << CHSM_NS_ALIAS << "::config_word const "
+        << sy->name() << SOURCES_SUFFIX << "[];" T_ENDL
+        << indent << "static "
+        << CHSM_NS_ALIAS << "::event::descriptor const "
+        << sy->name() << DESCRIPTOR_SUFFIX << ';' T_ENDL;
+  if ( !base_events( si ).empty() )
+    T_OUT << indent << "static "
+          << CHSM_NS_ALIAS << "::event::descriptor const *const "
+          << sy->name() << BASES_SUFFIX << "[];" T_ENDL;
+  T_OUT << "public:" T_ENDL;
 }
 
-void cpp_declarer::emit_common( parent_info const &si,
-                                char const *formal_params ) {
+void cpp_declarer::emit_common( parent_info const &si ) {
   symbol const *const sy = si.get_symbol();
   char const *const base_name = state_base_name( sy->name() );
 
@@ -438,14 +624,7 @@ void cpp_declarer::emit_common( parent_info const &si,
   }
 
   T_OUT << indent(2)
-        << PARENT_CLASS_PREFIX << base_name << "( CHSM_STATE_ARGS";
-
-  if ( formal_params != nullptr )
-    T_OUT << ", " << formal_params;
-
-  T_OUT << " );" T_ENDL
-        << indent << "private:" T_ENDL
-        << indent(2) << "static state::id const children_[];" T_ENDL
+        << PARENT_CLASS_PREFIX << base_name << "( CHSM_STATE_ARGS );" T_ENDL
         << indent << "} " << base_name << ';';
 }
 
@@ -511,6 +690,15 @@ void cpp_declarer::visit( chsm_info const &si ) {
           << chsm_info::PREFIX_TARGET << id
           << "( " << CHSM_NS_ALIAS << "::event const& );" T_ENDL;
 
+  // emit timeout delay member function declarations
+  T_OUT T_ENDL
+        << indent << "// timeout delays" T_ENDL;
+  for ( auto const &sy_event : si.events_ ) {
+    if ( INFO_CONST( event, sy_event )->kind_ == event_info::KIND_AFTER )
+      T_OUT << indent << "std::chrono::nanoseconds " << sy_event->name()
+            << DELAY_SUFFIX << "() const;" T_ENDL;
+  } // for
+
   // emit transition action member function declarations
   T_OUT T_ENDL
         << indent << "// transition actions" T_ENDL;
@@ -531,6 +719,13 @@ void cpp_declarer::visit( chsm_info const &si ) {
         << indent << CHSM_NS_ALIAS << "::state *state_["
         << si.states_.size() + 1 << "];" T_ENDL
 
+        << indent << "static " << CHSM_NS_ALIAS
+        << "::state::id const children_[];" T_ENDL
+        << indent << "static " << CHSM_NS_ALIAS
+        << "::state::descriptor const descriptor_[];" T_ENDL
+
+        << indent << "static " << CHSM_NS_ALIAS
+        << "::state::id const paths_[];" T_ENDL
         << indent << "static " << CHSM_NS_ALIAS
         << "::transition const transition_[];" T_ENDL
         << indent << CHSM_NS_ALIAS << "::event const *taken_["
@@ -542,6 +737,9 @@ void cpp_declarer::visit( chsm_info const &si ) {
         << (si.transitions_.empty() ? 1 : si.transitions_.size())
         << "];" T_ENDL
 
+        << indent << CHSM_NS_ALIAS << "::config_word config_["
+        << config_words() << "];" T_ENDL
+
         << "};" T_ENDL;
 
     emit_the_end();
@@ -553,7 +751,7 @@ void cpp_declarer::visit( child_info const& ) {
 }
 
 void cpp_declarer::visit( cluster_info const &si ) {
-  emit_common( si, "bool chsm_history_" );
+  emit_common( si );
 }
 
 void cpp_declarer::visit( event_info const &si ) {
@@ -627,6 +825,13 @@ void cpp_declarer::visit( user_event_info const &si ) {
           << indent(2) << '}' T_ENDL;
   }
 
+  // emit chsm_type() definition for event::is_type()
+  T_OUT << indent(2) << "static " << CHSM_NS_ALIAS
+        << "::event::descriptor const& chsm_type() {" T_ENDL
+        << indent(3)
+        << "return " << sy->name() << DESCRIPTOR_SUFFIX << ';' T_ENDL
+        << indent(2) << '}' T_ENDL;
+
   // emit event operator() declaration
   if ( si.has_any_parameters() ||
        si.precondition_ != user_event_info::PRECONDITION_NONE ) {
@@ -638,13 +843,18 @@ void cpp_declarer::visit( user_event_info const &si ) {
         << indent(2) << class_name( si )
         << "( CHSM_EVENT_ARGS ) : base_event( CHSM_EVENT_INIT ) { }" T_ENDL;
 
+  // emit post_again() definition so a pending event can be restored
+  if ( !si.has_any_parameters() ) {
+    T_OUT << indent(2) << "bool post_again( bool check_only ) {" T_ENDL
+          << indent(3) << "if ( !check_only )" T_ENDL
+          << indent(4) << "chsm().post( *this );" T_ENDL
+          << indent(3) << "return true;" T_ENDL
+          << indent(2) << '}' T_ENDL;
+  }
+
   // emit rest of event declaration
   T_OUT << indent(2) << "friend class " << cc.sy_chsm_->name() << ';' T_ENDL
-        << indent << "} " << sy->name() << ';' T_ENDL
-        << indent << "alignas(" << class_name( si ) << "::param_block) char "
-        << sy->name()
-        << "_param_block[ sizeof(" << class_name( si ) 
-        << "::param_block) ];" T_ENDL;
+        << indent << "} " << sy->name() << ';' T_ENDL;
 
   if ( si.precondition_ == user_event_info::PRECONDITION_FUNC ) {
     T_OUT << indent << "bool "
@@ -656,7 +866,7 @@ void cpp_declarer::visit( user_event_info const &si ) {
 
 ///////////////////////////////////////////////////////////////////////////////
 
-cpp_definer::cpp_definer() {
+cpp_definer::cpp_definer() : path_offset_{ 0 } {
 }
 
 void cpp_definer::emit() {
@@ -679,76 +889,179 @@ void cpp_definer::emit_chsm() {
 
 void cpp_definer::emit_common( event_info const &si ) {
   symbol const *const sy = si.get_symbol();
+  event_info::transition_id_list const transition_ids(
+    all_transition_ids( si )
+  );
 
   T_OUT << CHSM_NS_ALIAS << "::transition::id const "
         << cc.sy_chsm_->name() << "::"
         << sy->name() << TRANSITIONS_SUFFIX << "[] = {" T_ENDL
         << indent;
 
-  for ( auto const &tid : si.transition_ids_ )
+  for ( auto const &tid : transition_ids )
     T_OUT<< tid << ", ";
 
   T_OUT << -1 T_ENDL
         << "};" T_ENDL;
+
+  emit_dispatch( si, transition_ids );
+
+  //
+  // Emit the bitset of the event's "from" states.
+  //
+  vector<unsigned long long> sources( config_words() );
+  for ( auto const &tid : transition_ids ) {
+    auto const id = ::serial(
+      INFO_CONST( transition, CHSM->transitions_[ tid ] )->sy_from_
+    );
+    sources[ id / CONFIG_WORD_BITS ] |= 1ull << id % CONFIG_WORD_BITS;
+  } // for
+
+  T_OUT << CHSM_NS_ALIAS << "::config_word const "
+        << cc.sy_chsm_->name() << "::"
+        << sy->name() << SOURCES_SUFFIX << "[] = {" T_ENDL
+        << indent;
+  for ( auto const &word : sources )
+    T_OUT << "0x" << hex << word << dec << "ull, ";
+  T_OUT T_ENDL
+        << "};" T_ENDL;
+
+  //
+  // Emit the descriptors of the event's base events so event::is_type() can
+  // check whether an event is of a given type by indexing.
+  //
+  vector<symbol const*> const bases( base_events( si ) );
+  if ( !bases.empty() ) {
+    T_OUT << CHSM_NS_ALIAS << "::event::descriptor const *const "
+          << cc.sy_chsm_->name() << "::"
+          << sy->name() << BASES_SUFFIX << "[] = {" T_ENDL
+          << indent;
+    for ( auto const sy_base : bases )
+      T_OUT << '&' << sy_base->name() << DESCRIPTOR_SUFFIX << ", ";
+    T_OUT T_ENDL
+          << "};" T_ENDL;
+  }
+
+  T_OUT << CHSM_NS_ALIAS << "::event::descriptor const "
+        << cc.sy_chsm_->name() << "::"
+        << sy->name() << DESCRIPTOR_SUFFIX << " = {" T_ENDL
+        << indent << '"' << event_name( si ) << "\", "
+        << sy->name() << TRANSITIONS_SUFFIX << ", "
+        << sy->name() << DISPATCH_SUFFIX << ", "
+        << sy->name() << SOURCES_SUFFIX << ", ";
+  if ( bases.empty() )
+    T_OUT << "nullptr, 0";
+  else
+    T_OUT << sy->name() << BASES_SUFFIX << ", " << bases.size();
+  T_OUT T_ENDL
+        << "};" T_ENDL;
 }
 
-void cpp_definer::emit_common( parent_info const &si,
-                               char const *formal_params,
-                               char const *actual_params ) {
+void cpp_definer::emit_dispatch(
+    event_info const &si,
+    event_info::transition_id_list const &transition_ids ) {
+  //
+  // A dispatch entry indexes the range of the event's transitions from the
+  // same "from" state.  (A state's transitions are all declared together, so
+  // they're adjacent -- unless the state also has transitions on a base
+  // event, in which case the state has more than one entry.)
+  //
+  struct entry {
+    symbol const *sy_from_;
+    unsigned      first_, last_;
+  };
+
+  //
+  // A region is the list of entries whose "from" states have the same parent
+  // state.  Regions and their entries are kept in the order in which they're
+  // first seen.
+  //
+  struct region {
+    symbol const *sy_parent_;
+    vector<entry> entries_;
+  };
+  vector<region> regions;
+
+  unsigned i = 0;
+  for ( auto const &tid : transition_ids ) {
+    symbol const *const sy_from =
+      INFO_CONST( transition, CHSM->transitions_[ tid ] )->sy_from_;
+    symbol const *const sy_parent = INFO_CONST( state, sy_from )->sy_parent_;
+
+    auto r = regions.begin();
+    while ( r != regions.end() && r->sy_parent_ != sy_parent )
+      ++r;
+    if ( r == regions.end() )
+      r = regions.insert( r, region{ sy_parent, { } } );
+
+    if ( !r->entries_.empty() && r->entries_.back().sy_from_ == sy_from &&
+         r->entries_.back().last_ == i ) {
+      ++r->entries_.back().last_;
+    } else {
+      r->entries_.push_back( entry{ sy_from, i, i + 1 } );
+    }
+    ++i;
+  } // for
+
+  T_OUT << CHSM_NS_ALIAS << "::event::dispatch const "
+        << cc.sy_chsm_->name() << "::"
+        << si.get_symbol()->name() << DISPATCH_SUFFIX << "[] = {" T_ENDL;
+
+  for ( auto const &r : regions ) {
+    //
+    // Only one child of a cluster can be active, so the region is exclusive
+    // -- unless a "from" state somehow has more than one entry.
+    //
+    bool exclusive = INFO_CONST( cluster, r.sy_parent_ ) != nullptr;
+    for ( auto e = r.entries_.begin(); exclusive && e != r.entries_.end();
+          ++e ) {
+      for ( auto f = r.entries_.begin(); f != e; ++f ) {
+        if ( f->sy_from_ == e->sy_from_ ) {
+          exclusive = false;
+          break;
+        }
+      } // for
+    } // for
+
+    auto left = r.entries_.size();
+    for ( auto const &e : r.entries_ ) {
+      T_OUT << indent << "{ " << ::serial( e.sy_from_ ) << ", "
+            << e.first_ << ", " << e.last_ << ", " << left-- << ", "
+            << (exclusive ? "true" : "false") << " }," T_ENDL;
+    } // for
+  } // for
+
+  T_OUT << indent << "{ -1, 0, 0, 0, false }" T_ENDL
+        << "};" T_ENDL;
+}
+
+void cpp_definer::emit_common( parent_info const &si ) {
   symbol const *const sy = si.get_symbol();
   char const *const name = sy->name();
 
-  static char conv_buf[ 256 ];
+  string conv_name;
   { // local scope
     //
     // "Inline function" to convert a state name:
     //
     //      x.y.z -> Px::Py::Pz
     //
-    // (where P is a prefix) leaving the result in: conv_buf.
+    // (where P is a prefix) leaving the result in: conv_name.
     //
-    static int const prefix_length = ::strlen( PARENT_CLASS_PREFIX );
-    ::strcpy( conv_buf, PARENT_CLASS_PREFIX );
-    char *end = ::strchr( conv_buf, '\0' );
+    conv_name = PARENT_CLASS_PREFIX;
     for ( char const *c = name; *c; ++c ) {
-      if ( *c == '.' ) {
-        ::strcpy( end, "::" );
-        end += 2;
-        ::strcpy( end, PARENT_CLASS_PREFIX );
-        end += prefix_length;
-      } else {
-        *end++ = *c;
-      }
+      if ( *c == '.' )
+        (conv_name += "::") += PARENT_CLASS_PREFIX;
+      else
+        conv_name += *c;
     } // for
-    *end = '\0';
   } // end scope
 
-  // emit child state vector
-  T_OUT << CHSM_NS_ALIAS << "::state::id const "
-        << cc.sy_chsm_->name() << "::" << conv_buf << "::children_[] = {" T_ENDL
-        << indent;
-
-  for ( auto const &sy_child : si.children_ )
-    T_OUT<< ::serial( sy_child ) << ", ";
-
-  T_OUT << -1 T_ENDL
-        << "};" T_ENDL;
-
   // emit state constructor
-  T_OUT << cc.sy_chsm_->name() << "::" << conv_buf << "::"
+  T_OUT << cc.sy_chsm_->name() << "::" << conv_name << "::"
         << PARENT_CLASS_PREFIX
-        << state_base_name( name ) << "( CHSM_STATE_ARGS";
-
-  if ( formal_params != nullptr )
-    T_OUT << ", " << formal_params;
-
-  T_OUT << " ) :" T_ENDL
-        << indent << lib_class_name( si ) << "( CHSM_STATE_INIT, children_";
-
-  if ( actual_params != nullptr )
-    T_OUT << ", " << actual_params;
-
-  T_OUT << " )";
+        << state_base_name( name ) << "( CHSM_STATE_ARGS ) :" T_ENDL
+        << indent << lib_class_name( si ) << "( CHSM_STATE_INIT )";
 
   if ( &si != INFO_CONST( parent, SY_ROOT ) ) {
     //
@@ -767,6 +1080,93 @@ void cpp_definer::emit_common( parent_info const &si,
         << '}' T_ENDL;
 }
 
+void cpp_definer::emit_descriptors() {
+  vector<symbol const*> states{ SY_ROOT };
+  states.insert( states.end(), CHSM->states_.begin(), CHSM->states_.end() );
+
+  //
+  // Emit the child states of all the parents, each terminated by -1.
+  //
+  T_OUT << CHSM_NS_ALIAS << "::state::id const "
+        << cc.sy_chsm_->name() << "::children_[] = {" T_ENDL;
+  for ( auto const &sy_state : states ) {
+    if ( (type_of( sy_state ) & TYPE(PARENT)) == TYPE(NONE) )
+      continue;
+    T_OUT << indent;
+    for ( auto const &sy_child : INFO_CONST( parent, sy_state )->children_ )
+      T_OUT << ::serial( sy_child ) << ", ";
+    T_OUT << "-1," T_ENDL;
+  } // for
+  T_OUT << indent << "-1" T_ENDL
+        << "};" T_ENDL
+        T_ENDL;
+
+  //
+  // Emit the descriptors of all the states: the root's is first so the one
+  // of the state having ID i is at index i + 1.
+  //
+  child_offset_ = 0;
+  T_OUT << CHSM_NS_ALIAS << "::state::descriptor const "
+        << cc.sy_chsm_->name() << "::descriptor_[] = {" T_ENDL;
+  for ( auto const &sy_state : states ) {
+    auto const si = INFO_CONST( state, sy_state );
+    char const *const m_name = mangle( sy_state->name() );
+
+    T_OUT << indent << "{ \"" << sy_state->name() << "\", "
+          << ::serial( sy_state ) << ", "
+          << (si->sy_parent_ != nullptr ? ::serial( si->sy_parent_ ) : -1)
+          << ", ";
+
+    // enter/exit actions
+    if ( si->action_.has_enter_ )
+      T_OUT << "static_cast<" << CHSM_NS_ALIAS << "::state::action>(&"
+            << cc.sy_chsm_->name() << "::"
+            << chsm_info::PREFIX_ENTER << chsm_info::PREFIX_ACTION << m_name
+            << ')';
+    else
+      T_OUT << "nullptr";
+    T_OUT << ", ";
+    if ( si->action_.has_exit_ )
+      T_OUT << "static_cast<" << CHSM_NS_ALIAS << "::state::action>(&"
+            << cc.sy_chsm_->name() << "::"
+            << chsm_info::PREFIX_EXIT << chsm_info::PREFIX_ACTION << m_name
+            << ')';
+    else
+      T_OUT << "nullptr";
+    T_OUT << ", ";
+
+    // enter/exit events
+    if ( si->event_.has_enter_ )
+      T_OUT << "static_cast<" << CHSM_NS_ALIAS << "::state::event_member>(&"
+            << cc.sy_chsm_->name() << "::"
+            << chsm_info::PREFIX_ENTER << m_name << ')';
+    else
+      T_OUT << "nullptr";
+    T_OUT << ", ";
+    if ( si->event_.has_exit_ )
+      T_OUT << "static_cast<" << CHSM_NS_ALIAS << "::state::event_member>(&"
+            << cc.sy_chsm_->name() << "::"
+            << chsm_info::PREFIX_EXIT << m_name << ')';
+    else
+      T_OUT << "nullptr";
+    T_OUT << ", ";
+
+    // child states & history
+    if ( auto const pi = INFO_CONST( parent, sy_state ) ) {
+      T_OUT << "children_ + " << child_offset_;
+      child_offset_ += pi->children_.size() + 1;
+    }
+    else {
+      T_OUT << "nullptr";
+    }
+    auto const ci = INFO_CONST( cluster, sy_state );
+    T_OUT << ", " << (ci != nullptr && ci->history_ ? "true" : "false")
+          << " }," T_ENDL;
+  } // for
+  T_OUT << "};" T_ENDL
+        T_ENDL;
+}
+
 void cpp_definer::emit_events() {
   T_OUT << section_comment << "event definitions" T_ENDL
         T_ENDL;
@@ -780,6 +1180,7 @@ void cpp_definer::emit_events() {
 void cpp_definer::emit_states() {
   T_OUT << section_comment << "state definitions" T_ENDL
         T_ENDL;
+  emit_descriptors();
   INFO_CONST( parent, SY_ROOT )->accept( *this );
   T_OUT T_ENDL;
 
@@ -793,8 +1194,34 @@ void cpp_definer::emit_states() {
 
 void cpp_definer::emit_transitions() {
   T_OUT << section_comment << "transitions" T_ENDL
-        T_ENDL
-        << CHSM_NS_ALIAS << "::transition const "
+        T_ENDL;
+
+  //
+  // Emit the exit and enter paths of all the transitions having static "to"
+  // states, each terminated by -1.
+  //
+  T_OUT << CHSM_NS_ALIAS << "::state::id const "
+        << cc.sy_chsm_->name() << "::paths_[] = {" T_ENDL;
+  vector<int> exit_path, enter_path;
+  for ( auto const &sy_transition : CHSM->transitions_ ) {
+    if ( !transition_paths( *INFO_CONST( transition, sy_transition ),
+                            exit_path, enter_path ) ) {
+      continue;
+    }
+    T_OUT << indent;
+    for ( auto const id : exit_path )
+      T_OUT << id << ", ";
+    T_OUT << "-1, ";
+    for ( auto const id : enter_path )
+      T_OUT << id << ", ";
+    T_OUT << "-1," T_ENDL;
+  } // for
+  T_OUT << indent << "-1" T_ENDL
+        << "};" T_ENDL
+        T_ENDL;
+
+  path_offset_ = 0;
+  T_OUT << CHSM_NS_ALIAS << "::transition const "
         << cc.sy_chsm_->name() << "::transition_[] = {" T_ENDL;
 
   for ( auto const &sy_transition : CHSM->transitions_ ) {
@@ -802,7 +1229,8 @@ void cpp_definer::emit_transitions() {
     T_OUT T_ENDL;
   } // for
 
-  T_OUT << indent << "{ nullptr, 0, 0, nullptr, nullptr }" T_ENDL
+  T_OUT << indent << "{ nullptr, 0, 0, nullptr, nullptr, nullptr, nullptr }"
+           T_ENDL
         << "};" T_ENDL
         T_ENDL;
 }
@@ -830,7 +1258,7 @@ void cpp_definer::visit( chsm_info const &si ) {
     T_OUT << CHSM_NS_ALIAS << "::machine";
 
   T_OUT << "( state_, root, transition_, taken_, target_, "
-        << si.transitions_.size()
+        << si.transitions_.size() << ", config_, " << config_words()
         << param_list( si,
             param_data::EMIT_COMMA |
             param_data::EMIT_ACTUAL |
@@ -879,11 +1307,26 @@ void cpp_definer::visit( chsm_info const &si ) {
 }
 
 void cpp_definer::visit( cluster_info const &si ) {
-  emit_common( si, "bool chsm_history_", "chsm_history_" );
+  emit_common( si );
 }
 
 void cpp_definer::visit( event_info const &si ) {
   emit_common( si );
+
+  if ( si.kind_ == event_info::KIND_AFTER ) {
+    //
+    // Emit the timeout's delay function.  The delay expression is evaluated
+    // upon each entering of the state, so it needn't be constant.
+    //
+    symbol const *const sy = si.get_symbol();
+    T_OUT << "std::chrono::nanoseconds " << cc.sy_chsm_->name() << "::"
+          << sy->name() << DELAY_SUFFIX << "() const {" T_ENDL
+          << indent << "using namespace std::chrono_literals;" T_ENDL;
+    emit_source_line_no( T_OUT, si.first_ref_ );
+    T_OUT << indent << "return std::chrono::duration_cast<"
+          << "std::chrono::nanoseconds>( " << si.delay_ << " );" T_ENDL
+          << '}' T_ENDL;
+  }
 }
 
 void cpp_definer::visit( global_info const& ) {
@@ -928,12 +1371,23 @@ void cpp_definer::visit( transition_info const &si ) {
   else
     T_OUT << "nullptr";
 
+  T_OUT << ", ";
+
+  vector<int> exit_path, enter_path;
+  if ( transition_paths( si, exit_path, enter_path ) ) {
+    T_OUT << "paths_ + " << path_offset_ << ", ";
+    path_offset_ += exit_path.size() + 1;
+    T_OUT << "paths_ + " << path_offset_;
+    path_offset_ += enter_path.size() + 1;
+  } else {
+    T_OUT << "nullptr, nullptr";
+  }
+
   T_OUT << " },";
 }
 
 void cpp_definer::visit( user_event_info const &si ) {
   visit( static_cast<event_info const&>( si ) );
-  symbol const *const sy = si.get_symbol();
 
   if ( si.has_any_parameters() ) {
     //
@@ -994,12 +1448,13 @@ void cpp_definer::visit( user_event_info const &si ) {
           << "::operator()"
           << '(' << param_list( si, param_data::EMIT_FORMAL ) << ") {" T_ENDL
           << indent << "machine_lock const lock( machine_ );" T_ENDL
-          << indent << "if ( in_progress_ == 0 )" T_ENDL
-          << indent(2) << "broadcast( new( static_cast<" << cc.sy_chsm_->name()
-          << "&>(machine_)." << sy->name()
-          << "_param_block ) param_block( *this"
+          << indent << "broadcast(" T_ENDL
+          << indent(2) << "new( pool_allocate( sizeof( param_block ) ) )" T_ENDL
+          << indent(3) << "param_block( *this"
           << param_list( si, param_data::EMIT_COMMA | param_data::EMIT_ACTUAL )
-          << " ) );" T_ENDL
+          << " )," T_ENDL
+          << indent(2) << "true" T_ENDL
+          << indent << ");" T_ENDL
           << '}' T_ENDL;
   }
 }
@@ -1015,22 +1470,12 @@ void cpp_initializer::emit() {
 
 void cpp_initializer::emit_common( event_info const &si ) {
   symbol const *const sy = si.get_symbol();
-
-  T_OUT << indent << sy->name() << "( this, " << sy->name()
-        << TRANSITIONS_SUFFIX << ", \"";
-
-  if ( si.kind_ == event_info::KIND_USER )
-    T_OUT << sy->name();
-  else
-    T_OUT << (si.kind_ == event_info::KIND_ENTER ? "enter" : "exit")
-          << '(' << demangle( sy->name() + 1 ) << ')';
-
-  T_OUT << "\", ";
+  T_OUT << indent << sy->name() << "( this, "
+        << sy->name() << DESCRIPTOR_SUFFIX << ", ";
 }
 
 void cpp_initializer::emit_common( state_info const &si ) {
   symbol const *const sy = si.get_symbol();
-  char const *const m_name = mangle( sy->name() );
   //
   // If we're emitting a mem-initializer for the CHSM constructor, the
   // reference to the CHSM is *this; otherwise, we're emitting for a parent
@@ -1039,52 +1484,12 @@ void cpp_initializer::emit_common( state_info const &si ) {
   char const *const chsm_ref =
     emitting_constructor_ ? "*this" : "chsm_machine_";
 
-  T_OUT << indent << state_base_name( sy->name() ) << "( " << chsm_ref
-        << ", \"" << sy->name() << "\", "
-        << (si.sy_parent_ != nullptr ?
-            //
-            // The root state is "special" in that its children are not
-            // lexically enclosed by it; hence, we have to emit "&root" rather
-            // than "this".
-            //
-            (si.sy_parent_ == SY_ROOT ? "&root" : "this") :
-            //
-            // The root state is the only state with no parent.
-            //
-            "nullptr"
-          )
-        << ", ";
-
-  // enter/exit actions
-  if ( si.action_.has_enter_ )
-    T_OUT << "static_cast<" << CHSM_NS_ALIAS << "::state::action>(&"
-          << cc.sy_chsm_->name() << "::"
-          << chsm_info::PREFIX_ENTER << chsm_info::PREFIX_ACTION << m_name
-          << ')';
-  else
-    T_OUT << "nullptr";
-  T_OUT << ", ";
-  if ( si.action_.has_exit_ )
-    T_OUT << "static_cast<" << CHSM_NS_ALIAS << "::state::action>(&"
-          << cc.sy_chsm_->name() << "::"
-          << chsm_info::PREFIX_EXIT << chsm_info::PREFIX_ACTION << m_name
-          << ')';
-  else
-    T_OUT << "nullptr";
-  T_OUT << ", ";
-
-  // enter/exit events
-  if ( si.event_.has_enter_ )
-    T_OUT << "&((" << cc.sy_chsm_->name() << "&)" << chsm_ref << ")."
-          << chsm_info::PREFIX_ENTER << m_name;
-  else
-    T_OUT << "nullptr";
-  T_OUT << ", ";
-  if ( si.event_.has_exit_ )
-    T_OUT << "&((" << cc.sy_chsm_->name() << "&)" << chsm_ref << ")."
-          << chsm_info::PREFIX_EXIT << m_name;
-  else
-    T_OUT << "nullptr";
+  //
+  // The root's descriptor is first; see cpp_definer::emit_descriptors().
+  //
+  T_OUT << indent << state_base_name( sy->name() ) << "( " << chsm_ref << ", "
+        << cc.sy_chsm_->name() << "::descriptor_[" << ::serial( sy ) + 1
+        << ']';
 }
 
 void cpp_initializer::visit( child_info const& ) {
@@ -1097,12 +1502,18 @@ void cpp_initializer::visit( chsm_info const& ) {
 
 void cpp_initializer::visit( cluster_info const &si ) {
   emit_common( si );
-  T_OUT << ", " << (si.history_ ? "true" : "false") << " )";
+  T_OUT << " )";
 }
 
 void cpp_initializer::visit( event_info const &si ) {
   emit_common( si );
-  T_OUT << 0 << " )";
+  T_OUT << 0;
+  if ( si.kind_ == event_info::KIND_AFTER )
+    T_OUT << ", " << si.sy_state_->name()
+          << ", static_cast<" << CHSM_NS_ALIAS << "::timeout_event::delay>(&"
+          << cc.sy_chsm_->name() << "::"
+          << si.get_symbol()->name() << DELAY_SUFFIX << ')';
+  T_OUT << " )";
 }
 
 void cpp_initializer::visit( global_info const& ) {
@@ -45,7 +45,8 @@ struct event_info : global_info {
   enum kind {
     KIND_USER,                          ///< User event.
     KIND_ENTER,                         ///< Enter event.
-    KIND_EXIT                           ///< Exit event.
+    KIND_EXIT,                          ///< Exit event.
+    KIND_AFTER                          ///< Timeout event.
   };
 
   kind const kind_;                     ///< Kind of event.
@@ -54,20 +55,29 @@ struct event_info : global_info {
   transition_id_list transition_ids_;
 
   /**
-   * The state that this event is either an enter or exit event for.
+   * The state that this event is either an enter, exit, or timeout event for.
    * Used only if kind_ is not KIND_USER.
    */
   PJL::symbol const *const sy_state_;
 
+  /**
+   * The C++ expression for the delay of a timeout event.  Used only if kind_
+   * is KIND_AFTER.
+   */
+  std::string const delay_;
+
   /**
    * Constructs an %event_info.
    *
    * @param k The kind of event.
    * @param sy_state The state symbol that this evene is an enter or exit event
    * for, but only if this event is not a user_event.
+   * @param delay The C++ expression for the delay, but only if \a k is
+   * KIND_AFTER.
    */
   explicit event_info( kind k = KIND_USER,
-                       PJL::symbol const *sy_state = nullptr );
+                       PJL::symbol const *sy_state = nullptr,
+                       char const *delay = "" );
 
 };
 
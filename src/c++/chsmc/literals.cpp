@@ -28,6 +28,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 // CHSM
+char const L_AFTER[]    = "after";
 char const L_CHSM[]     = "chsm";
 char const L_CLUSTER[]  = "cluster";
 char const L_DEEP[]     = "deep";
@@ -34,6 +34,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 // CHSM
+extern char const L_AFTER[];
 extern char const L_CHSM[];
 extern char const L_CLUSTER[];
 extern char const L_DEEP[];
@@ -26,37 +26,31 @@
 #include <cctype>                       /* for isdigit() */
 #include <cstdlib>                      /* for atoi() */
 #include <cstring>
+#include <string>
 
 using namespace std;
 using namespace PJL;
 
-static char         g_mangle_buf[ 256 ];
+static string       g_mangle_buf;
 static char const   g_mangle_prefix[]   = "M";
 
 ///////////////////////////////////////////////////////////////////////////////
 
 char const* mangle( char const *s ) {
-  ::strcpy( g_mangle_buf, g_mangle_prefix );
+  g_mangle_buf = g_mangle_prefix;
   char const *in = s, *dot;
-  char *out = g_mangle_buf + 1;
-  int len;
   do {
     // length until '.' or to end of string if no '.'
     dot = ::strchr( in, '.' );
-    len = dot ? dot - in : ::strlen( in );
-
-    // paste length in
-    ::strcpy( out, ::itoa( len ) );
-    out += 1 + (len > 9);
+    size_t const len = dot ? dot - in : ::strlen( in );
 
-    // paste name in
-    while ( len-- )
-      *out++ = *in++;
-    ++in;
+    // paste length and name in
+    g_mangle_buf += ::ltoa( static_cast<long>( len ) );
+    g_mangle_buf.append( in, len );
+    in += len + 1;
   } while ( dot );
 
-  *out = '\0';
-  return g_mangle_buf;
+  return g_mangle_buf.c_str();
 }
 
 char const* demangle( char const *s ) {
@@ -66,18 +60,19 @@ char const* demangle( char const *s ) {
   if ( !isdigit( *in ) )                // not mangled to begin with
     return s;
 
-  char *out = g_mangle_buf;
+  g_mangle_buf.clear();
   int len;
 
   while ( (len = ::atoi( in )) != 0 ) {
-    in += 1 + (len > 9);
-    while ( len-- )
-      *out++ = *in++;
-    *out++ = '.';
+    while ( isdigit( *in ) )
+      ++in;
+    if ( !g_mangle_buf.empty() )
+      g_mangle_buf += '.';
+    g_mangle_buf.append( in, len );
+    in += len;
   } // while
 
-  *--out = '\0';
-  return g_mangle_buf;
+  return g_mangle_buf.c_str();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
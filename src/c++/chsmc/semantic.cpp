@@ -30,12 +30,12 @@
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <vector>
 
 using namespace PJL;
 using namespace std;
 
-static semantic sem_stack[ 100 ];
-static int      sem_stack_p = -1;
+static vector<semantic> sem_stack;
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -75,19 +75,20 @@ void semantic::check_tag( semantic::type_tag t, void const *p ) const {
 
 template<typename T>
 void stack_push( T v ) {
-  sem_stack[ ++sem_stack_p ] = v;
+  sem_stack.emplace_back( v );
 }
 
 template<typename T>
 void stack_pop( T *v ) {
-  assert( sem_stack_p >= 0 );
-  *v = sem_stack[ sem_stack_p-- ];
+  assert( !sem_stack.empty() );
+  *v = sem_stack.back();
+  sem_stack.pop_back();
 }
 
 template<typename T>
 void stack_peek( T *v, unsigned depth ) {
-  assert( static_cast<decltype(sem_stack_p)>( depth ) <= sem_stack_p );
-  *v = sem_stack[ sem_stack_p - depth ];
+  assert( depth < sem_stack.size() );
+  *v = sem_stack[ sem_stack.size() - 1 - depth ];
 }
 
 void push_line( int i, unsigned line ) {
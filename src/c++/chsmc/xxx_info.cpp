@@ -84,6 +84,7 @@ child_info::child_info( symbol const *sy_parent ) :
 ///////////////////////////////////////////////////////////////////////////////
 
 char const chsm_info::PREFIX_ACTION[]     = "A";
+char const chsm_info::PREFIX_AFTER[]      = "D";
 char const chsm_info::PREFIX_CONDITION[]  = "C";
 char const chsm_info::PREFIX_ENTER[]      = "E";
 char const chsm_info::PREFIX_EXIT[]       = "X";
@@ -113,9 +114,11 @@ cluster_info::cluster_info( symbol const *sy_parent, char const *derived,
 
 CHSM_DEFINE_RTTI( event_info, TYPE(ENEX_EVENT) );
 
-event_info::event_info( kind k, PJL::symbol const *sy_state ) :
+event_info::event_info( kind k, PJL::symbol const *sy_state,
+                        char const *delay ) :
   kind_{ k },
-  sy_state_{ sy_state }
+  sy_state_{ sy_state },
+  delay_{ delay }
 {
 }
 
@@ -0,0 +1,100 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/batch.cpp -- Run-Time library implementation
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#define CHSM_NO_ALIAS_NS
+#include "chsm.h"
+#include "util.h"
+
+// standard
+#include <algorithm>
+#include <new>
+
+using namespace std;
+
+namespace CHSM_NS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+machine::batch::batch() :
+  chunks_{ nullptr },
+  cur_chunk_{ nullptr },
+  cur_used_{ 0 }
+{
+  // do nothing else
+}
+
+machine::batch::~batch() {
+  clear();
+  while ( chunk *const c = chunks_ ) {
+    chunks_ = c->next_;
+    ::operator delete( c );
+  } // while
+}
+
+void* machine::batch::allocate( size_t size ) {
+  size_t const align = alignof( max_align_t );
+  size = (size + align - 1) / align * align;
+
+  if ( unlikely( cur_chunk_ == nullptr ||
+                 cur_used_ + size > cur_chunk_->size_ ) ) {
+    //
+    // Move on to the next chunk, if any, left over from a previous use of
+    // this batch; otherwise (or if it's too small), insert a new one.
+    //
+    chunk *next = cur_chunk_ != nullptr ? cur_chunk_->next_ : chunks_;
+    if ( next == nullptr || next->size_ < size ) {
+      size_t const bytes = max( size, size_t{ CHSM_BATCH_CHUNK_SIZE } );
+      chunk *const c = static_cast<chunk*>(
+        ::operator new( sizeof( chunk ) + bytes )
+      );
+      c->next_ = next;
+      c->size_ = bytes;
+      if ( cur_chunk_ != nullptr )
+        cur_chunk_->next_ = c;
+      else
+        chunks_ = c;
+      next = c;
+    }
+    cur_chunk_ = next;
+    cur_used_ = 0;
+  }
+
+  void *const p = reinterpret_cast<char*>( cur_chunk_ + 1 ) + cur_used_;
+  cur_used_ += size;
+  return p;
+}
+
+void machine::batch::clear() {
+  for ( auto const &e : entries_ )
+    static_cast<event::param_block*>( e.param_block_ )->~param_block();
+  reset();
+}
+
+void machine::batch::reset() {
+  entries_.clear();
+  cur_chunk_ = nullptr;
+  cur_used_ = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+/* vim:set et sw=2 ts=2: */
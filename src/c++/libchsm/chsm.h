@@ -49,29 +49,376 @@
  */
 
 // standard
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <initializer_list>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 /**
  * Defines the long CHSM namespace name.  This shouldn't ever conflict with
  * anything.  See the end of this file for more on namespaces.
+ *
+ * The name also encodes the options below that change the layout of classes
+ * so that code compiled with options other than those libchsm was compiled
+ * with fails to link (with undefined references) rather than silently
+ * corrupting memory.
+ */
+#define CHSM_NS                                       \
+  CHSM_NS_ABI_( CHSM_ABI_METRICS_, CHSM_INBOX_BLOCK_SIZE, \
+                CHSM_EVENT_QUEUE_CAPACITY )
+#define CHSM_NS_ABI_(M,I,Q)       CHSM_NS_ABI_PASTE_(M,I,Q)
+#define CHSM_NS_ABI_PASTE_(M,I,Q) \
+  Concurrent_Hierarchical_State_Machine_##M##_i##I##_q##Q
+
+//
+// If CHSM_NO_DEBUG is defined, the run-time library's debugging code is
+// compiled out: machine::is_debug() always returns false (so the compiler
+// eliminates every branch it guards) and machine::debug() does nothing.  It's
+// defined when compiling libchsm if --disable-chsm-debug is given to
+// configure, in which case libchsm_debug is also built with debugging intact.
+//
+// Likewise, if CHSM_NO_TRACE is defined, recording trace records is compiled
+// out: machine::record_trace() does nothing and machine::trace_records() is
+// always empty.  It's defined along with CHSM_NO_DEBUG so that, with both,
+// nothing the transition algorithm does tests whether to trace.
+//
+
+/**
+ * The number of bytes of in-place storage each machine inbox entry has for a
+ * param_block.  Param blocks larger than this are allocated on the heap.
+ *
+ * @note If you change this, you must change it (to an integer literal) both
+ * when compiling libchsm and your own code; otherwise, linking fails.
+ */
+#ifndef CHSM_INBOX_BLOCK_SIZE
+#define CHSM_INBOX_BLOCK_SIZE     64
+#endif /* CHSM_INBOX_BLOCK_SIZE */
+
+/**
+ * The number of events a machine's event queue can hold before it has to
+ * allocate memory.
+ *
+ * @note If you change this, you must change it (to an integer literal) both
+ * when compiling libchsm and your own code; otherwise, linking fails.
+ */
+#ifndef CHSM_EVENT_QUEUE_CAPACITY
+#define CHSM_EVENT_QUEUE_CAPACITY 8
+#endif /* CHSM_EVENT_QUEUE_CAPACITY */
+
+/**
+ * The number of param_blocks an event's pool grows by whenever it runs out.
+ * It's used only within libchsm, so it matters only when compiling libchsm.
  */
-#define CHSM_NS Concurrent_Hierarchical_State_Machine
+#ifndef CHSM_PARAM_POOL_CHUNK_SIZE
+#define CHSM_PARAM_POOL_CHUNK_SIZE 8
+#endif /* CHSM_PARAM_POOL_CHUNK_SIZE */
+
+/**
+ * The number of bytes of param_block storage a machine::batch allocates at a
+ * time.  It's used only within libchsm, so it matters only when compiling
+ * libchsm.
+ */
+#ifndef CHSM_BATCH_CHUNK_SIZE
+#define CHSM_BATCH_CHUNK_SIZE     4096
+#endif /* CHSM_BATCH_CHUNK_SIZE */
+
+//
+// If CHSM_NO_METRICS is defined, the run-time metrics (see machine::metrics())
+// are compiled out.  It's defined when compiling libchsm if
+// --disable-chsm-metrics is given to configure.  Since that changes the sizes
+// of classes, it must be defined (or not) both when compiling libchsm and
+// your own code; otherwise, linking fails.
+//
+#ifdef CHSM_NO_METRICS
+# define CHSM_ABI_METRICS_ nm
+#else
+# define CHSM_ABI_METRICS_ m
+#endif /* CHSM_NO_METRICS */
 
 namespace CHSM_NS {
 
 ///////////////////////////////////////////////////////////////////////////////
 
-typedef std::recursive_mutex mutex_type;
+/**
+ * A %lock_policy specifies how (or whether) a machine's mutex is locked.
+ *
+ * @sa machine::set_lock_policy()
+ */
+enum class lock_policy : std::uint8_t {
+  /**
+   * The mutex is a `std::recursive_mutex`: any thread may broadcast to or
+   * post to the machine at any time.  This is the default.
+   */
+  RECURSIVE,
+
+  /**
+   * The mutex is a spin lock: a single compare-and-swap to acquire and a
+   * store to release, but it busy-waits (while yielding) when contended.  Any
+   * thread may still broadcast to or post to the machine, but this is meant
+   * for machines that are externally synchronized so that it's rarely (if
+   * ever) contended.
+   */
+  SPIN,
+
+  /**
+   * The mutex isn't locked at all.  This is only for machines that are
+   * confined to a single thread: every broadcast, post, and timeout must
+   * happen on that thread or the machine must be bound to an executor (in
+   * which case the executor's thread is that thread, so events may only be
+   * posted).
+   */
+  NONE
+};
+
+/**
+ * @internal
+ *
+ * A %machine_mutex is a machine's mutex.  Like a `std::recursive_mutex`, the
+ * thread that holds it may lock it again, e.g., when an action broadcasts an
+ * event to its own machine; but how it's actually locked depends on its
+ * lock_policy.
+ */
+class machine_mutex {
+public:
+  machine_mutex() : depth_{ 0 }, policy_{ lock_policy::RECURSIVE } { }
+
+  void lock() {
+    switch ( policy_ ) {
+      case lock_policy::RECURSIVE:
+        recursive_.lock();
+        break;
+      case lock_policy::SPIN:
+        if ( !spin_try_lock() )
+          spin_lock_slow();
+        break;
+      case lock_policy::NONE:
+        break;
+    } // switch
+  }
+
+  bool try_lock() {
+    switch ( policy_ ) {
+      case lock_policy::RECURSIVE:
+        return recursive_.try_lock();
+      case lock_policy::SPIN:
+        return spin_try_lock();
+      default:
+        return true;
+    } // switch
+  }
+
+  void unlock() {
+    switch ( policy_ ) {
+      case lock_policy::RECURSIVE:
+        recursive_.unlock();
+        break;
+      case lock_policy::SPIN:
+        if ( --depth_ == 0 )
+          owner_.store( std::thread::id{}, std::memory_order_release );
+        break;
+      case lock_policy::NONE:
+        break;
+    } // switch
+  }
+
+  lock_policy policy() const noexcept {
+    return policy_;
+  }
+
+  /**
+   * Sets the %lock_policy.  The mutex must not be held by any thread.
+   *
+   * @param p The new %lock_policy.
+   */
+  void set_policy( lock_policy p ) noexcept {
+    policy_ = p;
+  }
+
+private:
+  std::recursive_mutex recursive_;
+  std::atomic<std::thread::id> owner_;  ///< The SPIN thread holding us.
+  unsigned depth_;                      ///< SPIN lock depth of owner_.
+  lock_policy policy_;
+
+  /**
+   * Attempts to acquire the SPIN lock without waiting.  Only the thread that
+   * holds it can ever load its own ID from owner_, so that check is safe
+   * without any ordering.
+   *
+   * @return Returns `true` only if the lock was acquired.
+   */
+  bool spin_try_lock() {
+    std::thread::id const self = std::this_thread::get_id();
+    if ( owner_.load( std::memory_order_relaxed ) == self ) {
+      ++depth_;
+      return true;
+    }
+    std::thread::id none;
+    if ( !owner_.compare_exchange_strong( none, self,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed ) )
+      return false;
+    depth_ = 1;
+    return true;
+  }
+
+  /**
+   * Acquires the SPIN lock, yielding until another thread releases it.
+   */
+  void spin_lock_slow();
+
+  machine_mutex( machine_mutex const& ) = delete;
+  machine_mutex& operator=( machine_mutex const& ) = delete;
+};
+
+typedef machine_mutex mutex_type;
 typedef std::unique_lock<mutex_type> lock_type;
 
+/**
+ * A %config_word is a word of a bitset of the states of a machine: bit
+ * <i>i</i> % 64 of word <i>i</i> / 64 is for the state whose ID is <i>i</i>.
+ */
+typedef std::uint64_t config_word;
+
+/**
+ * The number of bits in a config_word.
+ */
+#define CHSM_CONFIG_WORD_BITS     64
+
+#ifndef CHSM_NO_METRICS
+/**
+ * A %metric is a run-time counter.  It's changed only by the thread holding
+ * its machine's mutex, so changing it is merely a relaxed load and store
+ * rather than a locked read-modify-write; it may be read by any thread at any
+ * time.
+ */
+class metric {
+public:
+  metric() : n_{ 0 } { }
+
+  /**
+   * Gets the value of this %metric.
+   *
+   * @return Returns said value.
+   */
+  std::uint64_t get() const {
+    return n_.load( std::memory_order_relaxed );
+  }
+
+  /**
+   * Adds to this %metric.
+   *
+   * @param n The amount to add.
+   */
+  void add( std::uint64_t n ) {
+    n_.store( get() + n, std::memory_order_relaxed );
+  }
+
+  /**
+   * Sets this %metric to \a n if \a n is greater.
+   *
+   * @param n The value to maximize against.
+   */
+  void max( std::uint64_t n ) {
+    if ( n > get() )
+      n_.store( n, std::memory_order_relaxed );
+  }
+
+  metric& operator++() {
+    add( 1 );
+    return *this;
+  }
+
+private:
+  std::atomic<std::uint64_t> n_;
+};
+
+/**
+ * A %latency_histogram is a log-bucketed (HDR-style) histogram of latencies in
+ * nanoseconds.  Each power of 2 is split into `SUB_BUCKETS` linear buckets, so
+ * a recorded value is off by at most 1/`SUB_BUCKETS` of itself.  Like a
+ * metric, it's changed only by the thread holding its machine's mutex and may
+ * be read by any thread at any time.
+ */
+class latency_histogram {
+public:
+  static unsigned const SUB_BUCKET_BITS = 3;
+  static unsigned const SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+  static unsigned const BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  /**
+   * Gets the number of latencies recorded.
+   *
+   * @return Returns said number.
+   */
+  std::uint64_t count() const;
+
+  /**
+   * Gets a percentile of the latencies recorded.
+   *
+   * @param q The quantile in the range [0,1], e.g., 0.99 for p99.
+   * @return Returns the greatest latency (in nanoseconds) of the bucket
+   * containing the percentile or 0 if no latencies have been recorded.
+   */
+  std::uint64_t percentile( double q ) const;
+
+  std::uint64_t p50() const  { return percentile( 0.5   ); }
+  std::uint64_t p99() const  { return percentile( 0.99  ); }
+  std::uint64_t p999() const { return percentile( 0.999 ); }
+
+  /**
+   * Records a latency.
+   *
+   * @param ns The latency in nanoseconds.
+   */
+  void record( std::uint64_t ns ) {
+    ++buckets_[ bucket_of( ns ) ];
+  }
+
+private:
+  /**
+   * Gets the index of the bucket for a latency.
+   *
+   * @param ns The latency in nanoseconds.
+   * @return Returns said index.
+   */
+  static unsigned bucket_of( std::uint64_t ns );
+
+  /**
+   * Gets the greatest latency of a bucket.
+   *
+   * @param bucket The index of the bucket.
+   * @return Returns said latency in nanoseconds.
+   */
+  static std::uint64_t bucket_max( unsigned bucket );
+
+  metric buckets_[ BUCKETS ];
+};
+#endif /* CHSM_NO_METRICS */
+
 class   machine;
 class   state;
 class   parent;
 class   cluster;
 class   set;
 class   event;
+class   timeout_event;
+class   executor;
+class   fleet_base;
+class   thread_executor;
+class   timer_wheel;
 struct  transition;
 
 // macros to aid in argument-lists
@@ -97,12 +444,7 @@ public:
   //
 # define  CHSM_STATE_ARG_LIST(A)                        \
           A(CHSM_NS::machine&) chsm_machine_,           \
-          A(char const*) chsm_name_,                    \
-          A(CHSM_NS::parent*) chsm_parent_,             \
-          A(CHSM_NS::state::action) chsm_enter_action_, \
-          A(CHSM_NS::state::action) chsm_exit_action_,  \
-          A(CHSM_NS::event*) chsm_enter_event_,         \
-          A(CHSM_NS::event*) chsm_exit_event_
+          A(CHSM_NS::state::descriptor const&) chsm_descriptor_
 
   /**
    * Defines the constructor arguments for the CHSM::state class.
@@ -133,6 +475,43 @@ public:
    */
   typedef void (machine::*action)( state const &s, event const &trigger );
 
+  /**
+   * An \e event_member is a pointer to an %event data member of a machine.
+   */
+  typedef event machine::*event_member;
+
+  /**
+   * @internal
+   *
+   * A %descriptor holds the data of a %state that never changes and so is the
+   * same for every instance of its machine.  The CHSM-to-C++ compiler emits a
+   * static table of them per machine class so that a %state itself holds only
+   * what does change.
+   *
+   * As with CHSM::transition, the data members aren't declared `const` so the
+   * table can be aggregate-initialized.
+   */
+  struct descriptor {
+    char const   *name_;                ///< State name.
+    id            id_;                  ///< State ID; -1 for the root.
+    id            parent_id_;           ///< Parent ID; -1 for the root.
+
+    /**
+     * See the comment for the "action" declaration.
+     */
+    action        enter_action_, exit_action_;
+
+    /**
+     * The enter/exit events for the %state are non-null only if they are
+     * actually used in the machine.  Their values are determined by the
+     * CHSM-to-C++ compiler.
+     */
+    event_member  enter_event_, exit_event_;
+
+    id const     *children_;            ///< Child states; parents only.
+    bool          history_;             ///< Has a history?  Clusters only.
+  };
+
   /**
    * Constructs a %state.
    *
@@ -165,6 +544,16 @@ public:
     return (state_ & STATE_ACTIVE) != 0;
   }
 
+  /**
+   * Gets whether this %state was active at the end of its machine's most
+   * recent micro-step.  Unlike active(), this may be called from any thread
+   * while the machine is running.
+   *
+   * @return Returns `true` only if the %state was active.
+   * @sa machine::published_config()
+   */
+  bool published_active() const;
+
   /**
    * Gets the `machine` that this %state belongs to.
    *
@@ -189,7 +578,7 @@ public:
    * @return Returns said name.
    */
   char const* name() const {
-    return name_;
+    return desc_.name_;
   }
 
   /**
@@ -197,9 +586,7 @@ public:
    *
    * @return Returns the parent or null if none.
    */
-  parent* parent_of() const {
-    return parent_;
-  }
+  parent* parent_of() const;
 
   // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
@@ -264,8 +651,7 @@ private:
   state( state const& ) = delete;
   state& operator=( state const& ) = delete;
 
-  char const  *const name_;             ///< State name.
-  parent      *const parent_;           ///< Parent, if any.
+  descriptor const &desc_;              ///< Data that never changes.
 
   static unsigned const STATE_INACTIVE        = 0x00;
   static unsigned const STATE_ACTIVE          = 0x01;
@@ -279,22 +665,21 @@ private:
   unsigned state_;                      ///< The %state of the %state.
 
   /**
-   * See the comment for the "action" declaration.
+   * The timeout events armed whenever this %state is entered, if any.
    */
-  action const enter_action_, exit_action_;
+  timeout_event *timeouts_;
 
-  /**
-   * The enter/exit events for the %state are non-null only if they are
-   * actually used in the machine.  Their values are determined by the CHSM-to-
-   * C++ compiler.
-   */
-  event *const enter_event_, *const exit_event_;
+#ifndef CHSM_NO_METRICS
+  metric enters_;                       ///< Times entered.
+  metric exits_;                        ///< Times exited.
+#endif /* CHSM_NO_METRICS */
 
   friend class cluster;
   friend class event;
   friend class machine;
   friend class parent;
   friend class set;
+  friend class timeout_event;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -375,6 +760,20 @@ struct transition {
    */
   action action_;
 
+  /**
+   * The IDs of the ancestors of the "from" state to exit after it (innermost
+   * first) terminated by -1, or null if the "to" state isn't static.
+   */
+  state::id const *exit_path_;
+
+  /**
+   * The IDs of the ancestors of the "to" state below the least common
+   * ancestor of it and the "from" state (outermost first) followed by the
+   * "to" state itself terminated by -1, or null if the "to" state isn't
+   * static.
+   */
+  state::id const *enter_path_;
+
   /**
    * Checks whether this transition is internal.
    *
@@ -431,10 +830,76 @@ protected:
 public:
   // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-# define  CHSM_EVENT_ARG_LIST(A)                    \
-          A(CHSM_NS::machine*) chsm_machine_,       \
-          A(transition_list) chsm_transition_list_, \
-          A(char const*) chsm_name_,                \
+  /**
+   * The identification number of an %event: its position among the events of
+   * its machine in order of construction.
+   */
+  typedef int id;
+
+  /**
+   * @internal
+   *
+   * A %dispatch is an entry in an %event's dispatch table emitted by the
+   * CHSM-to-C++ compiler.  It indexes the transitions of the %event from a
+   * particular "from" state so that only those of active states need to be
+   * checked.  The entries for "from" states having the same parent state (a
+   * "region") are adjacent so that all of them can be skipped if the parent
+   * isn't active; and, if the parent is a CHSM::cluster, the rest of them can
+   * be skipped once its active child has been found.  Since the entries are
+   * therefore not in the order in which the transitions were declared, the
+   * active ones are sorted by `first_` before their transitions are found.
+   *
+   * As with CHSM::transition, the data members aren't declared `const` so the
+   * tables can be aggregate-initialized.
+   */
+  struct dispatch {
+    state::id       from_id_;           ///< "From" state; -1 ends the table.
+    unsigned        first_;             ///< Index of first transition.
+    unsigned        last_;              ///< Index one past last transition.
+    unsigned        region_left_;       ///< Entries left in region (incl.).
+    bool            exclusive_;         ///< Is the region's parent a cluster?
+  };
+
+  typedef dispatch const *dispatch_table;
+
+  /**
+   * @internal
+   *
+   * A %descriptor holds the data of an %event that never changes and so is
+   * the same for every instance of its machine.  The CHSM-to-C++ compiler
+   * emits a static one per %event.
+   *
+   * As with CHSM::transition, the data members aren't declared `const` so it
+   * can be aggregate-initialized.
+   */
+  struct descriptor {
+    char const         *name_;          ///< Event name.
+
+    /**
+     * This is the set of transitions an %event possibly triggers, including
+     * those of its base events (after its own), so it never has to walk the
+     * chain of base events.  It has to be a "native" C++ array of int rather
+     * than, say, an STL vector because the CHSM-to-C++ compiler emits native
+     * arrays that are aggregate initialized.
+     */
+    transition_list     transitions_;
+
+    dispatch_table      dispatch_;      ///< Dispatch table for transitions_.
+    config_word const  *sources_;       ///< Bitset of transitions_' "from"s.
+
+    /**
+     * The descriptors of the %event's base events, outermost first, or null
+     * if none.  Indexing it by the number of bases of a would-be base event
+     * checks whether it is one in O(1).
+     */
+    descriptor const *const *bases_;
+
+    unsigned            depth_;         ///< Number of base events.
+  };
+
+# define  CHSM_EVENT_ARG_LIST(A)                            \
+          A(CHSM_NS::machine*) chsm_machine_,               \
+          A(CHSM_NS::event::descriptor const&) chsm_descriptor_, \
           A(CHSM_NS::event*) chsm_base_event_
 
   /**
@@ -481,14 +946,42 @@ public:
 
   /**
    * Checks whether this %event is of a particular event type.  This function
-   * is a convenient shorthand.
+   * is a convenient shorthand.  For %event classes emitted by the CHSM-to-C++
+   * compiler, it takes constant time and needs no RTTI.
    *
    * @tparam EventClass The %event class's type.
    * @return Returns `true` only if this %event is of the given type.
    */
   template<class EventClass> bool is_type() const {
-    return dynamic_cast<EventClass const*>( this ) != nullptr;
+    if constexpr ( std::is_same<EventClass,event>::value ) {
+      return true;
+    } else if constexpr ( has_chsm_type<EventClass>::value ) {
+      descriptor const &d = EventClass::chsm_type();
+      return &d == &desc_ ||
+        (d.depth_ < desc_.depth_ && desc_.bases_[ d.depth_ ] == &d);
+    } else {
+      return dynamic_cast<EventClass const*>( this ) != nullptr;
+    }
+  }
+
+#ifndef CHSM_NO_METRICS
+  /**
+   * Gets the histogram of this %event's latencies: the time from its being
+   * broadcast (including queueing behind other events) to the end of the
+   * micro-step that took its transitions.  The times are read once per
+   * micro-step rather than per event, so they're precise only to within a
+   * micro-step.  Latencies are recorded only while machine::record_latency()
+   * is on.
+   *
+   * @return Returns said histogram.
+   */
+  latency_histogram const& latency() const {
+    extras const *const x = extras_.load( std::memory_order_acquire );
+    latency_histogram const *const h =
+      x != nullptr ? x->latency_.load( std::memory_order_acquire ) : nullptr;
+    return h != nullptr ? *h : NO_LATENCY_;
   }
+#endif /* CHSM_NO_METRICS */
 
   /**
    * Returns the name of this %event.
@@ -496,7 +989,7 @@ public:
    * @return Returns said name.
    */
   char const* name() const {
-    return name_;
+    return desc_.name_;
   }
 
   // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -524,7 +1017,10 @@ protected:
      *
      * @param e The event to be a parameter block for.
      */
-    explicit param_block( event const &e ) : chsm_event_{ e } { }
+    explicit param_block( event const &e ) :
+      chsm_event_{ e }, chsm_next_{ nullptr }, chsm_pooled_{ false }
+    {
+    }
 
     /**
      * Destroys a %param_block.
@@ -543,6 +1039,18 @@ protected:
      */
     event const &chsm_event_;
 
+    /**
+     * The next %param_block of the same event waiting to be broadcast, if
+     * any.
+     */
+    param_block *chsm_next_;
+
+    /**
+     * Whether this %param_block was obtained from pool_allocate().  It's set
+     * when it's broadcast or parked.
+     */
+    bool chsm_pooled_;
+
     /**
      * The reason for having `chsm()` returning the owning event's machine is
      * that only this %param_block is a friend of the event class: by having a
@@ -577,19 +1085,21 @@ protected:
   /**
    * @internal
    *
-   * The `in_progress_` "flag" is actually a counter because, during a
-   * transition, the same %event (or an %event derived from it) can be
-   * broadcast more than once; however, nothing must be done for "nested"
-   * broadcasts, i.e., when it's &gt; 0.
+   * The storage for param_block_.  It's used only by %events having no base
+   * %event.
    */
-  unsigned in_progress_;
+  void *param_slot_;
 
   /**
    * @internal
    *
-   * The current param_block, if any.
+   * The current param_block, if any.  An %event and all %events derived from
+   * it, directly or indirectly, share the same one (the param_slot_ of the
+   * most-base %event) since a derived %event's param_block is-a base's.  The
+   * param_block of a derived %event being broadcast is thus also that of its
+   * base %events without having to copy it into each.
    */
-  void *param_block_;
+  void *&param_block_;
 
   /**
    * @internal
@@ -599,23 +1109,142 @@ protected:
    * this %event: if one is found, queue it and run the CHSM transition
    * algorithm.
    *
+   * If the %event is already in progress, a param_block is parked rather
+   * than dropped: the %event is broadcast again with it as soon as its
+   * current broadcast has completed, so every instance keeps its own
+   * parameters.  (A param_block not obtained from pool_allocate() must
+   * therefore outlive the transition algorithm.)
+   *
    * @param param_block A pointer to a param_block, if any.
+   * @param pooled If `true`, \a param_block was obtained from
+   * pool_allocate().
+   */
+  void broadcast( void *param_block, bool pooled = false );
+
+  /**
+   * @internal
+   *
+   * Allocates memory for a param_block from this %event's pool.  The pool
+   * grows in chunks of `CHSM_PARAM_POOL_CHUNK_SIZE` param_blocks as needed;
+   * once grown, no further memory is allocated since a param_block is
+   * returned to the pool when its broadcast completes.
+   *
+   * @param size The size of the param_block.  It must be the same for every
+   * call.
+   * @return Returns memory suitably aligned for any param_block whose
+   * alignment is at most that of `std::max_align_t`.
+   */
+  void* pool_allocate( std::size_t size );
+
+  /**
+   * @internal
+   *
+   * Posts this %event to its machine again.  It's used to restore the events
+   * that were pending when a snapshot was taken.  Since the parameters of a
+   * posted %event can't be recovered, the CHSM-to-C++ compiler overrides this
+   * only for events having no parameters.
+   *
+   * @param check_only If `true`, only checks whether this %event can be
+   * posted again, but doesn't post it.
+   * @return Returns `true` only if this %event can be (or was) posted again.
+   * The default always returns `false`.
    */
-  void broadcast( void *param_block );
+  virtual bool post_again( bool check_only );
 
 private:
-  char const *const           name_;              ///< Event name.
+  /**
+   * A %pool_block is what's in a free block of an event's param_block pool or
+   * at the front of one of its chunks.
+   */
+  struct pool_block {
+    pool_block *next_;                  ///< Next free block or chunk.
+  };
+
+  /**
+   * An %extras holds the data an %event needs only once it's been used in
+   * certain ways: its param_block pool once it's been broadcast with
+   * parameters, its parked param_blocks once one has been parked, and its
+   * latency data once latencies are being recorded.  It's allocated only
+   * when first needed so that an %event that needs none of it stays small.
+   */
+  struct extras {
+    pool_block   *pool_free_{ nullptr };        ///< Free blocks, if any.
+    pool_block   *pool_chunks_{ nullptr };      ///< Allocated chunks, if any.
+    std::size_t   pool_block_size_{ 0 };        ///< Size of each pool block.
+    param_block  *parked_head_{ nullptr };      ///< Oldest parked param_block.
+    param_block  *parked_tail_{ nullptr };      ///< Newest parked param_block.
+#ifndef CHSM_NO_METRICS
+    std::uint64_t queued_ns_{ 0 };              ///< When queued.
+
+    /**
+     * The histogram of broadcast-to-completion latencies.  It's allocated
+     * only once the first latency is recorded.
+     */
+    std::atomic<latency_histogram*> latency_{ nullptr };
+#endif /* CHSM_NO_METRICS */
+  };
+
+  void                       *own_param_block_;   ///< Being broadcast, if any.
+
+  /**
+   * Our %extras, if allocated yet.  It's allocated only by the thread holding
+   * our machine's mutex, but latency() may read it from any thread.
+   */
+  std::atomic<extras*>        extras_;
+
+  descriptor const           &desc_;              ///< Data that never changes.
   event      *const           base_event_;        ///< Base event, if any.
+
+  /**
+   * Checks whether an %event class is one emitted by the CHSM-to-C++
+   * compiler, i.e., has a static `chsm_type()` returning its descriptor.
+   *
+   * @tparam EventClass The %event class's type.
+   */
+  template<class EventClass,typename = void>
+  struct has_chsm_type : std::false_type { };
+
+  template<class EventClass>
+  struct has_chsm_type<
+    EventClass,std::void_t<decltype( EventClass::chsm_type() )>
+  > : std::true_type { };
   static transition::id const NO_TRANSITION_ID_;  ///< Sentinel for end().
 
+  event  *next_event_;                  ///< Next event of machine, if any.
+
+  /**
+   * The `in_progress_` "flag" is actually a counter because, during a
+   * transition, the same %event (or an %event derived from it) can be
+   * broadcast more than once; however, nothing must be done for "nested"
+   * broadcasts, i.e., when it's &gt; 0.
+   */
+  unsigned in_progress_;
+
+  id      id_;                          ///< Our ID; -1 if no machine.
+
+#ifndef CHSM_NO_METRICS
+  metric  broadcasts_;                  ///< Times broadcast.
+  metric  rejected_;                    ///< Times precondition was false.
+  metric  cancelled_;                   ///< Times no transition was found.
+
+  static latency_histogram const NO_LATENCY_; ///< Returned when none.
+
   /**
-   * This is the set of transitions an %event possibly triggers.  It has to be
-   * a "native" C++ array of int rather than, say, an STL vector because the
-   * CHSM-to-C++ compiler emits native arrays that are aggregate initialized.
+   * Records a latency of this %event.  It must be called only by the thread
+   * holding its machine's mutex.
+   *
+   * @param ns The latency in nanoseconds.
    */
-  transition_list const transitions_;
+  void record_latency( std::uint64_t ns );
+#endif /* CHSM_NO_METRICS */
 
-  bool is_debug_events() const;
+  /**
+   * Gets our %extras, allocating it if necessary.  It must be called only by
+   * the thread holding our machine's mutex.
+   *
+   * @return Returns said %extras.
+   */
+  extras& extras_of();
 
   /**
    * Returns whether this %event has no transitions.
@@ -623,7 +1252,7 @@ private:
    * @return Returns `true` only if this %event has no transitions.
    */
   bool empty() const {
-    return *transitions_ == NO_TRANSITION_ID_;
+    return *desc_.transitions_ == NO_TRANSITION_ID_;
   }
 
   /**
@@ -631,17 +1260,57 @@ private:
    */
   void lock_broadcast();
 
-  class const_iterator;
-  friend class const_iterator;
+  /**
+   * Evaluates this %event's precondition, if any, and finds transitions that
+   * are to be taken in response to it: if one is found, queues this %event
+   * and runs the CHSM transition algorithm.
+   *
+   * @param pb A pointer to a param_block, if any.
+   * @return Returns `false` only if the broadcast was cancelled.
+   */
+  bool enqueue( void *pb );
 
   /**
-   * This is an iterator in "STL style" to iterate over the transitions an
-   * %event possibly triggers.
+   * Parks a param_block to be broadcast once this %event is no longer in
+   * progress.
+   *
+   * @param pb The param_block to park.
+   * @param pooled If `true`, \a pb was obtained from pool_allocate().
    */
-  class const_iterator {
-  public:
-    /** The type of the value returned by iterator and const_iterator. */
-    typedef transition value_type;
+  void park( param_block *pb, bool pooled );
+
+  /**
+   * Destroys the param_block, if any, of the broadcast that has just been
+   * completed (or cancelled), returns it to the pool if pooled, and unmarks
+   * this %event and its base events as being in progress.
+   */
+  void release();
+
+  /**
+   * Removes the oldest parked param_block, but only if this %event is no
+   * longer in progress.
+   *
+   * @return Returns said param_block or null if none.
+   */
+  param_block* unpark();
+
+  /**
+   * Broadcasts each of our base events' oldest parked param_block, if any,
+   * that are no longer in progress.
+   */
+  void broadcast_parked_bases();
+
+  class const_iterator;
+  friend class const_iterator;
+
+  /**
+   * This is an iterator in "STL style" to iterate over the transitions an
+   * %event possibly triggers.
+   */
+  class const_iterator {
+  public:
+    /** The type of the value returned by iterator and const_iterator. */
+    typedef transition value_type;
 
     /** A pointer to a `const value_type`. */
     typedef value_type const* const_pointer;
@@ -690,7 +1359,6 @@ private:
      */
     const_iterator& operator++() {
       ++t_id_;
-      bump();
       return *this;
     }
 
@@ -733,20 +1401,12 @@ private:
   protected:
     const_pointer     t_;               ///< Machine's transitions.
     transition_list   t_id_;
-    event const      *base_event_;      ///< Base event, if any.
 
-    const_iterator( const_pointer t, transition_list id, event const *b ) :
-      t_{ t }, t_id_{ id }, base_event_{ b }
+    const_iterator( const_pointer t, transition_list id ) :
+      t_{ t }, t_id_{ id }
     {
-      bump();
     }
 
-  private:
-    /**
-     * Bumps the iterator to the next transition, if any.
-     */
-    void bump();
-
     friend class event;
   };
 
@@ -765,11 +1425,13 @@ private:
    * @return Returns said iterator.
    */
   const_iterator end() const {
-    return const_iterator{ nullptr, &NO_TRANSITION_ID_, nullptr };
+    return const_iterator{ nullptr, &NO_TRANSITION_ID_ };
   }
 
   /**
-   * Does post-broadcast clean-up for a broadcasted event.
+   * Does post-broadcast clean-up for a broadcasted event, then broadcasts
+   * its (and its base events') next parked param_block, if any.  Such a
+   * broadcast is queued for the next micro-step.
    */
   void broadcasted();
 
@@ -781,9 +1443,19 @@ private:
    */
   bool find_transition();
 
+  /**
+   * Checks whether a transition (of this %event or one of its base events) is
+   * to be taken and, if so, marks it as taken.
+   *
+   * @param tid The ID of the transition.
+   * @return Returns `true` only if it's to be taken.
+   */
+  bool find_transition( transition::id tid );
+
   event( event const& ) = delete;
   event& operator=( event const& ) = delete;
 
+  friend class  fleet_base;
   friend class  machine;
   friend bool   state::enter( event const&, state* );
   friend bool   state::exit ( event const&, state* );
@@ -860,7 +1532,9 @@ public:
           A(CHSM_NS::transition const) chsm_transition_ A([]),  \
           A(CHSM_NS::event const*) chsm_taken_ A([]),           \
           A(CHSM_NS::state*) chsm_target_ A([]),                \
-          A(unsigned) chsm_transitions_in_machine_
+          A(unsigned) chsm_transitions_in_machine_,             \
+          A(CHSM_NS::config_word) chsm_config_ A([]),           \
+          A(unsigned) chsm_config_words_
 
   /**
    * Defines the constructor arguments for the CHSM::machine class.
@@ -1061,7 +1735,11 @@ public:
    * @return Returns said state.
    */
   debug_mask debug() const {
+#ifdef CHSM_NO_DEBUG
+    return DEBUG_NONE;
+#else
     return debug_state_;
+#endif /* CHSM_NO_DEBUG */
   }
 
   /**
@@ -1072,11 +1750,18 @@ public:
    * debugging states #DEBUG_ENTER_EXIT, #DEBUG_EVENTS, #DEBUG_ALGORITHM, or
    * #DEBUG_ALL.
    * @return Returns the previous debugging state.
+   *
+   * @note If #CHSM_NO_DEBUG is defined, this does nothing.
    */
   debug_mask debug( debug_mask debug_state ) {
+#ifdef CHSM_NO_DEBUG
+    (void)debug_state;
+    return DEBUG_NONE;
+#else
     debug_mask const temp = debug_state_;
     debug_state_ = debug_state;
     return temp;
+#endif /* CHSM_NO_DEBUG */
   }
 
   /**
@@ -1087,620 +1772,2268 @@ public:
    * debug_state.
    */
   bool is_debug( debug_mask debug_state ) const {
+#ifdef CHSM_NO_DEBUG
+    (void)debug_state;
+    return false;
+#else
     return (debug_state_ & debug_state) != 0;
+#endif /* CHSM_NO_DEBUG */
   }
 
   /**
    * Dumps a printout of the current state to standard error.  The dump
    * consists of each state's name, one per line, preceded by an asterisk only
-   * if it is active; a space otherwise.
+   * if it is active; a space otherwise.  The state is that of
+   * published_config(), so this never blocks the transition algorithm.
    */
   void dump_state() const;
 
-  // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
-protected:
-  /**
-   * Constructs a %machine.
-   *
-   * When deriving a class from %machine, the macros `CHSM_MACHINE_ARGS` and
-   * `CHSM_MACHINE_INIT` can be used to avoid having to deal with the many
-   * constructor arguments, e.g.:
-   * @code
-   *  class my_machine : public CHSM::machine {
-   *  public:
-   *    my_machine( CHSM_MACHINE_ARGS ) : 
-   *      CHSM::machine{ CHSM_MACHINE_INIT } {
-   *      // ...
-   *    }
-   *    // ...
-   *  };
-   * @endcode
-   */
-  machine( CHSM_MACHINE_ARGS );
-
-private:
-  /**
-   * The type of the queue of events that have been broadcasted.
-   */
-  typedef std::deque<event*> event_queue;
-
-  /**
-   * The entire set of states in the machine.  This is built and set by the
-   * CHSM-to-C++ compiler.
-   */
-  state *const *const state_;
-
   /**
-   * The outermost cluster encompassing the entire machine.
+   * The kind of a trace_record.
    */
-  cluster &root_;
+  enum trace_kind : std::uint8_t {
+    // DEBUG_ENTER_EXIT
+    TRACE_ENTER,                        ///< Entering a state.
+    TRACE_EXIT,                         ///< Exiting a state.
+
+    // DEBUG_EVENTS
+    TRACE_BROADCAST,                    ///< Broadcasting an event.
+    TRACE_CANCELLED,                    ///< Broadcast cancelled.
+    TRACE_CHECKING,                     ///< Checking an event's transitions.
+    TRACE_DEQUEUED,                     ///< Event dequeued.
+    TRACE_FOUND,                        ///< Transition found.
+    TRACE_PARKED,                       ///< Broadcast parked.
+    TRACE_PRECONDITION,                 ///< Precondition evaluated.
+    TRACE_QUEUED,                       ///< Event queued.
+
+    // DEBUG_ALGORITHM
+    TRACE_ACTION,                       ///< Performing a transition's action.
+    TRACE_ALGORITHM_BEGIN,              ///< Transition algorithm beginning.
+    TRACE_ALGORITHM_END,                ///< Transition algorithm complete.
+    TRACE_ITERATING,                    ///< Iterating an event's transitions.
+    TRACE_MICRO_STEP,                   ///< Micro-step beginning.
+    TRACE_PERFORMING,                   ///< Performing a transition.
+    TRACE_PHASE_I,                      ///< Phase I: exit "from" states.
+    TRACE_PHASE_II,                     ///< Phase II: enter "to" states.
+    TRACE_PHASE_III                     ///< Phase III: dequeue events.
+  };
 
   /**
-   * The entire set of transitions in the machine.  This is built and set by
-   * the CHSM-to-C++ compiler.
+   * A %trace_record is a compact binary record of a single step a %machine
+   * takes.  Recording one involves no formatting; dump_trace() renders them
+   * as the same text that the debugging states print.  A record refers to
+   * states, events, and transitions only by ID, so records mean the same
+   * thing outside of the process that recorded them (see save_trace()).
    */
-  transition const *const transition_;
+  struct trace_record {
+    std::uint64_t   time_;              ///< When, in clock nanoseconds.
+    transition::id  transition_;        ///< Transition ID, count, or flag.
+    state::id       state_;             ///< The state ID, if any; else -1.
+    event::id       event_;             ///< The event ID, if any; else -1.
+    trace_kind      kind_;              ///< The kind of record.
+    std::uint8_t    indent_;            ///< The debugging indentation.
+  };
 
   /**
-   * The number of transitions in the machine.  This is set by the CHSM-to-C++
-   * compiler.
+   * A %trace_symbols is everything besides the records themselves needed to
+   * render trace records as text: the names of a %machine's states and events
+   * and the "from" state of each of its transitions.
    */
-  unsigned const transitions_in_machine_;
+  struct trace_symbols {
+    std::string               root_;    ///< The name of the root cluster.
+    std::vector<std::string>  states_;  ///< State names by state::id.
+    std::vector<std::string>  events_;  ///< Event names by event::id.
+    std::vector<state::id>    from_;    ///< "From" IDs by transition::id.
+  };
 
   /**
-   * An array to pointers to events indexed by transition::id.  It's used to
-   * mark a transition as "taken" so it's taken at most once per transition
-   * algorithm execution for a given event.
+   * Gets the symbols of this %machine needed to render its trace records.
+   *
+   * @return Returns said symbols.
    */
-  event const **const taken_;
+  trace_symbols symbols() const;
 
   /**
-   * An array of pointers to states indexed by state::id.  It's used store the
-   * states to transition to for a given transition.
+   * Starts (or stops) recording trace records in a ring buffer.  Once the
+   * ring is full, each new record overwrites the oldest.  Recording is
+   * independent of the debugging state and is meant to be left on so that the
+   * most recent steps are available when a %machine misbehaves.
+   *
+   * @param capacity The number of records the ring holds.  It's rounded up to
+   * a power of 2.  If 0, stops recording and discards all records.  If
+   * CHSM_NO_TRACE is defined, this does nothing.
+   *
+   * @note This must not be called while the %machine is running nor
+   * concurrently with trace_records() since it frees the old ring.
    */
-  state **const target_;
+  void record_trace( size_t capacity );
 
   /**
-   * This is `true` only when the transition algorithm is in progress and is
-   * used to prevent recursive calls.
+   * Gets the trace records currently in the ring buffer.  This doesn't lock
+   * the %machine, so it can be called at any time from any thread (even from
+   * a debugger or a signal handler's thread while the %machine is stuck)
+   * without blocking the transition algorithm.  Records still being written
+   * or overwritten while being read are omitted.
+   *
+   * @return Returns said records from oldest to newest.
    */
-  bool in_progress_;
-
-  event_queue event_queue_;             ///< Events that have been broadcasted.
-  unsigned    debug_indent_;            ///< Current debugging indentation.
-  debug_mask  debug_state_;             ///< Current debugging state.
-
-  static state const *const NIL_;       ///< Sentinel for end().
-  static state::id const    NO_STATE_ID_; ///< Used by internal transitions.
+  std::vector<trace_record> trace_records() const;
 
   /**
-   * Performs all the transitions for all events queued.
+   * Dumps the trace records currently in the ring buffer from oldest to
+   * newest as the same indented text that the debugging states print.
+   *
+   * @param o The ostream to dump to.
    */
-  void algorithm();
+  void dump_trace( std::ostream &o = std::cerr ) const;
 
   /**
-   * @internal
-   *
-   * Emits the debugging preamble, including indenting the current number of
-   * spaces.
+   * Saves the trace records currently in the ring buffer along with this
+   * %machine's symbols in a compact, versioned, binary form that can be
+   * rendered by load_trace() and print_trace() without this %machine, e.g.,
+   * after being written to a file by a process that has since died.
    *
-   * @return Returns the stream to continue emitting debugging information to.
+   * @param buf The buffer to save the trace into.
    */
-  std::ostream& dout() const;
-
-  friend class event;
-  friend class parent;
-  friend class state;
-  friend struct transition;
-
-  mutable mutex_type mutex_;
-  friend struct event::machine_lock;
-};
-
-///////////////////////////////////////////////////////////////////////////////
+  void save_trace( std::vector<std::uint8_t> &buf ) const;
 
-/**
- * A %parent \e is-an abstract state that has child states.
- *
- * It is an implementation detail to factor common data members and member
- * functions for the CHSM::cluster and CHSM::set classes.
- *
- * @author Paul J. Lucas
- */
-class parent : public state {
-protected:
   /**
-   * @internal
+   * Loads a trace saved by save_trace().
    *
-   * The array of state IDs that are the child states.
+   * @param data A pointer to the saved trace.
+   * @param size The size of the saved trace.
+   * @param s The symbols to load into.
+   * @param records The records to load into from oldest to newest.
+   * @return Returns `true` only if the trace was loaded.  It isn't if it's
+   * malformed or of an unknown version.
    */
-  typedef id const* child_list;
-
-public:
-# define  CHSM_PARENT_ARG_LIST(A)     \
-          CHSM_STATE_ARG_LIST(A),     \
-          A(child_list) chsm_children_
+  static bool load_trace( void const *data, std::size_t size,
+                          trace_symbols &s,
+                          std::vector<trace_record> &records );
 
   /**
-   * Defines the constructor arguments for the CHSM::parent class.
+   * Prints a trace record as the same text that the debugging states print.
    *
-   * @hideinitializer
+   * @param o The ostream to print to.
+   * @param r The trace record to print.
+   * @param s The symbols of the %machine that recorded \a r.
    */
-# define CHSM_PARENT_ARGS         CHSM_PARENT_ARG_LIST(CHSM_FORMAL)
+  static void print_trace( std::ostream &o, trace_record const &r,
+                           trace_symbols const &s );
 
+#ifndef CHSM_NO_METRICS
   /**
-   * Defines the base-class constructor argument \e mem-initializers for the
-   * CHSM::parent class.
-   *
-   * @hideinitializer
+   * A %metrics_snapshot is a copy of the run-time metrics of a %machine.
    */
-# define CHSM_PARENT_INIT         CHSM_PARENT_ARG_LIST(CHSM_ACTUAL)
-
-  /** The type of the value returned by iterator and const_iterator. */
-  typedef state value_type;
+  struct metrics_snapshot {
+    /**
+     * The metrics of an event.
+     */
+    struct event_metrics {
+      event const  *event_;             ///< The event.
+      std::uint64_t broadcasts_;        ///< Times broadcast.
+      std::uint64_t rejected_;          ///< Times precondition was false.
+      std::uint64_t cancelled_;         ///< Times no transition was found.
+    };
 
-  /** A pointer to a `value_type`. */
-  typedef value_type* pointer;
+    /**
+     * The metrics of a state.
+     */
+    struct state_metrics {
+      std::uint64_t enters_;            ///< Times entered.
+      std::uint64_t exits_;             ///< Times exited.
+    };
 
-  /** A pointer to a `const value_type`. */
-  typedef value_type const* const_pointer;
+    std::uint64_t micro_steps_;         ///< Micro-steps performed.
 
-  /** A reference to a `value_type`. */
-  typedef value_type& reference;
+    /**
+     * The total number of events in all micro-steps: divide by micro_steps_
+     * for the mean number of events per micro-step.
+     */
+    std::uint64_t micro_step_events_;
 
-  /** A reference to a `const value_type`. */
-  typedef value_type const& const_reference;
+    std::uint64_t max_micro_step_events_; ///< Most events in a micro-step.
 
-  /**
-   * Clears this parent's history.  However, since parents don't have a
-   * history, there is nothing to do for them; however, calls `deep_clear()`
-   * for all child states.
-   */
-  void deep_clear() override;
+    std::vector<event_metrics> events_;       ///< In no particular order.
+    std::vector<state_metrics> states_;       ///< Indexed by state ID.
+    std::vector<std::uint64_t> transitions_;  ///< Taken, by transition ID.
+  };
 
   /**
-   * Returns whether this parent has no child states.
+   * Takes a snapshot of the run-time metrics of this %machine.  It doesn't
+   * lock the %machine: each metric is read atomically, but metrics may be
+   * changing while being read so they may not all be mutually consistent.
    *
-   * @return Returns `true` only if this parent has no child states.
+   * @param s The metrics_snapshot to copy into.  Reusing one avoids
+   * allocating memory.
+   *
+   * @note This is available only if `CHSM_NO_METRICS` isn't defined.
    */
-  bool empty() const {
-    return *children_ == NO_CHILD_ID_;
-  }
+  void metrics( metrics_snapshot &s ) const;
 
   /**
-   * Returns a parent::reference to the first child state.
+   * Takes a snapshot of the run-time metrics of this %machine.
    *
-   * @return Returns said reference.
+   * @return Returns said snapshot.
+   * @see metrics(metrics_snapshot&) const
    */
-  reference front() {
-    return *(machine_.state_)[ *children_ ];
-  }
+  metrics_snapshot metrics() const;
 
   /**
-   * Returns a parent::const_reference to the first child state.
+   * Starts (or stops) recording the latency of every %event of this %machine
+   * (see event::latency()).  It's off by default since, when on, the clock is
+   * read for every micro-step and each %event's histogram is allocated the
+   * first time a latency is recorded for it.
    *
-   * @return Returns said reference.
+   * @param on Whether to record latencies.
+   *
+   * @note This must not be called from within one of the %machine's own
+   * actions.  It's available only if `CHSM_NO_METRICS` isn't defined.
    */
-  const_reference front() const {
-    return *(machine_.state_)[ *children_ ];
-  }
-
-  class iterator;
-  friend class iterator;
+  void record_latency( bool on );
+#endif /* CHSM_NO_METRICS */
 
   /**
-   * This is an iterator in "STL style" to iterate over the child states of a
-   * parent state.
+   * A %configuration is a snapshot of which states of a %machine are active.
+   * It's a bitset indexed by state ID so taking a snapshot is a single copy
+   * and comparing or hashing configurations is proportional to the number of
+   * states divided by `CHSM_CONFIG_WORD_BITS`.
    */
-  class iterator {
+  class configuration {
   public:
     /**
-     * Constructs an %iterator.
+     * Constructs an empty %configuration.
      */
-    iterator() { }
+    configuration() { }
 
     /**
-     * Returns a parent::reference to the state the %iterator is positioned at.
+     * Gets the number of active states.
      *
-     * @return Returns said reference.
+     * @return Returns said number.
      */
-    reference operator*() const {
-      return *p_[ *c_ ];
-    }
+    std::size_t count() const;
 
     /**
-     * Returns a parent::pointer to the state the %iterator is positioned at.
+     * Gets the words of the bitset.
      *
-     * @return Returns said pointer.
+     * @return Returns a pointer to the first word.
      */
-    pointer operator->() const {
-      return p_[ *c_ ];
+    config_word const* data() const {
+      return words_.data();
     }
 
     /**
-     * Pre-increments the %iterator.
+     * Computes a hash value for this %configuration.
      *
-     * @return Returns the %iterator positioned at the next state, if any.
+     * @return Returns said hash value.
      */
-    iterator& operator++() {
-      return ++c_, *this;
+    std::size_t hash() const;
+
+    /**
+     * Gets the number of words in the bitset.
+     *
+     * @return Returns said number.
+     */
+    std::size_t size() const {
+      return words_.size();
     }
 
     /**
-     * Post-increments the %iterator.
+     * Gets whether a state was active.
      *
-     * @return Returns a new %iterator positioned at the state the original
-     * %iterator was positioned at prior to the increment.
+     * @param id The ID of the state.
+     * @return Returns `true` only if the state was active.
      */
-    iterator operator++(int) {
-      return iterator( p_, c_++ );
+    bool test( state::id id ) const {
+      return (words_[ id / CHSM_CONFIG_WORD_BITS ] &
+              config_word{ 1 } << id % CHSM_CONFIG_WORD_BITS) != 0;
     }
 
     /**
-     * Compares two iterators for equality.
+     * Compares two configurations for equality.
      *
-     * @param i The first %iterator.
-     * @param j The second %iterator.
-     * @return Returns `true` only if the two iterators are positioned at
-     * the same state.
+     * @param i The first %configuration.
+     * @param j The second %configuration.
+     * @return Returns `true` only if the same states are active in both.
      */
-    friend bool operator==( iterator const &i, iterator const &j ) {
-      return *i.c_ == *j.c_;
+    friend bool operator==( configuration const &i, configuration const &j ) {
+      return i.words_ == j.words_;
     }
 
     /**
-     * Compares two iterators for inequality.
+     * Compares two configurations for inequality.
      *
-     * @param i The first %iterator.
-     * @param j The second %iterator.
-     * @return Returns `true` only if the two iterators are not positioned at
-     * the same state.
+     * @param i The first %configuration.
+     * @param j The second %configuration.
+     * @return Returns `true` only if different states are active.
      */
-    friend bool operator!=( iterator const &i, iterator const &j ) {
+    friend bool operator!=( configuration const &i, configuration const &j ) {
       return !(i == j);
     }
 
-  protected:
-    pointer const  *p_;
-    child_list      c_;
-
-    iterator( pointer const *p, child_list c ) : p_{ p }, c_{ c } { }
+  private:
+    std::vector<config_word> words_;    ///< The bitset.
 
-    friend class parent;
+    friend class machine;
   };
 
   /**
-   * Returns a parent::iterator positioned at the first child state of a
-   * parent.
+   * Takes a snapshot of which states are currently active.
    *
-   * @return Returns said iterator.
+   * @return Returns said snapshot.
    */
-  iterator begin() {
-    return iterator{ machine_.state_, children_ };
-  }
+  configuration config() const;
 
   /**
-   * Returns a parent::iterator positioned at one past the last child state of
-   * a parent.
+   * Takes a snapshot of which states are currently active, reusing the
+   * storage of an existing %configuration.
    *
-   * @return Returns said iterator.
+   * @param c The %configuration to copy the snapshot into.
    */
-  iterator end() {
-    return iterator{ nullptr, &NO_CHILD_ID_ };
-  }
+  void config( configuration &c ) const;
 
-  class const_iterator;
-  friend class const_iterator;
+  /**
+   * Gets whether the states that are currently active are exactly those of
+   * a %configuration.
+   *
+   * @param c The %configuration to compare against.
+   * @return Returns `true` only if they are.
+   */
+  bool is_config( configuration const &c ) const;
 
   /**
-   * This is an iterator in "STL style" to iterate over the child states of a
-   * parent state.
+   * Takes a snapshot of which states were active at the end of the most
+   * recent micro-step (or when this %machine was last entered, exited, or
+   * restored).  Unlike config(), this never acquires the %machine's mutex, so
+   * it may be called from any thread at any time, e.g., by a monitoring
+   * thread, without ever contending with the transition algorithm.
+   *
+   * The configuration is published into one of two buffers while readers
+   * read the other.  A reader retries only in the unlikely event that two
+   * further micro-steps complete while it's reading.
+   *
+   * @param c The %configuration to copy the snapshot into.
+   * @sa state::published_active()
    */
-  class const_iterator {
-  public:
-    /**
-     * Constructs a %const_iterator.
-     */
-    const_iterator() { }
+  void published_config( configuration &c ) const;
 
-    /**
-     * Returns a parent::const_reference to the state the iterator is
-     * positioned at.
+  /**
+   * Takes a snapshot of which states were active at the end of the most
+   * recent micro-step.
+   *
+   * @return Returns said snapshot.
+   * @see published_config(configuration&) const
+   */
+  configuration published_config() const;
+
+  /**
+   * Waits until a state is active at the end of a micro-step (see
+   * published_config()) or a timeout elapses, whichever is first.  The
+   * calling thread sleeps until a micro-step completes rather than polling.
+   *
+   * @param s The state to wait for.
+   * @param timeout The maximum time to wait; the default is forever.
+   * @return Returns `true` only if \a s is active.
+   * @note This must not be called either from within one of the %machine's
+   * own actions or from the thread of its executor.
+   * @sa wait_until_any()
+   */
+  bool wait_until( state const &s, std::chrono::nanoseconds timeout =
+                   std::chrono::nanoseconds::max() ) {
+    return wait_until_any( { &s }, timeout ) != nullptr;
+  }
+
+  /**
+   * Waits until any of some states is active at the end of a micro-step (see
+   * published_config()) or a timeout elapses, whichever is first.  For
+   * example:
+   * @code
+   *  if ( m.wait_until_any( { &m.done, &m.failed }, 5s ) == &m.failed )
+   *    // ...
+   * @endcode
+   *
+   * @param states The states to wait for.
+   * @param timeout The maximum time to wait; the default is forever.
+   * @return Returns the first of \a states found to be active or null if
+   * the timeout elapsed first.
+   * @note This must not be called either from within one of the %machine's
+   * own actions or from the thread of its executor.
+   */
+  state const* wait_until_any( std::initializer_list<state const*> states,
+                               std::chrono::nanoseconds timeout =
+                                 std::chrono::nanoseconds::max() );
+
+  /**
+   * A %snapshot is the compact, versioned, binary form of the run-time state
+   * of a %machine: which states are active, the history of inactive clusters,
+   * and which events have been posted but not yet broadcast.  It can be
+   * restored into any %machine of the same class built from the same CHSM
+   * description, e.g., in another process.
+   */
+  typedef std::vector<std::uint8_t> snapshot_data;
+
+  /**
+   * Takes a snapshot of this %machine.
+   *
+   * @param buf The buffer to put the snapshot into.  Reusing one avoids
+   * allocating memory.
+   * @return Returns `true` only if the snapshot was taken.  It can't be if
+   * either this is called from within one of this %machine's own actions or
+   * one of the events posted to it but not yet broadcast has parameters
+   * (since they can't be recovered).  Posted timeout events are omitted
+   * since restoring arms timeouts anew.
+   */
+  bool snapshot( snapshot_data &buf ) const;
+
+  /**
+   * Restores a snapshot into this %machine.  The states in the snapshot are
+   * made active without performing their enter actions nor broadcasting
+   * their enter events; all other states are made inactive likewise.  The
+   * timeouts of the active states are armed as if they had just been entered.
+   * Once restored, the events that were pending are posted again.
+   *
+   * @param data A pointer to the snapshot.
+   * @param size The size of the snapshot.
+   * @return Returns `true` only if the snapshot was restored.  It isn't if
+   * this is called from within one of this %machine's own actions, events
+   * have been posted to this %machine but not yet broadcast, or the snapshot
+   * is malformed, of an unknown version, or of a different %machine; in these
+   * cases, this %machine is unchanged.  Hence a snapshot should be restored
+   * only into an idle %machine.
+   */
+  bool restore( void const *data, std::size_t size );
+
+  /**
+   * Restores a snapshot into this %machine.
+   *
+   * @param buf The snapshot.
+   * @return Returns `true` only if the snapshot was restored.
+   * @see restore(void const*,std::size_t)
+   */
+  bool restore( snapshot_data const &buf ) {
+    return restore( buf.data(), buf.size() );
+  }
+
+  /**
+   * A %batch is a sequence of events, each with its parameters, to be
+   * broadcast together via broadcast_batch().  Building a %batch doesn't
+   * involve the %machine at all (so it doesn't lock it); a %batch can be
+   * reused after it's been broadcast without allocating memory again.
+   *
+   * For example, given `event digit(int n);` and `event done;`:
+   * @code
+   *  CHSM::machine::batch b;
+   *  b.add( m.digit, 4 ).add( m.digit, 2 ).add( m.done );
+   *  m.broadcast_batch( b );
+   * @endcode
+   */
+  class batch {
+  public:
+    /**
+     * Constructs an empty %batch.
+     */
+    batch();
+
+    /**
+     * Destroys a %batch including the parameters of any events not
+     * broadcast.
+     */
+    ~batch();
+
+    /**
+     * Appends an %event and its parameters to this %batch.
      *
-     * @return Returns said reference.
+     * @tparam EventClass The class of the %event.
+     * @tparam Args The types of the %event's parameters.
+     * @param e The %event to append.
+     * @param args The %event's parameters, if any.
+     * @return Returns this %batch.
      */
-    const_reference operator*() const {
-      return *p_[ *c_ ];
+    template<class EventClass,typename... Args>
+    batch& add( EventClass &e, Args&&... args );
+
+    /**
+     * Removes all events from this %batch without broadcasting them.
+     */
+    void clear();
+
+    /**
+     * Gets whether this %batch has no events.
+     *
+     * @return Returns `true` only if it has none.
+     */
+    bool empty() const {
+      return entries_.empty();
     }
 
     /**
-     * Returns a parent::const_pointer to the state the iterator is positioned
-     * at.
+     * Gets the number of events in this %batch.
      *
-     * @return Returns said reference.
+     * @return Returns said number.
      */
-    const_pointer operator->() const {
-      return p_[ *c_ ];
+    std::size_t size() const {
+      return entries_.size();
     }
 
+    batch( batch const& ) = delete;
+    batch& operator=( batch const& ) = delete;
+
+  private:
     /**
-     * Pre-increments the iterator.
+     * An %entry is an %event in a %batch along with its param_block.
+     */
+    struct entry {
+      event *event_;                    ///< The event to broadcast.
+      void  *param_block_;              ///< The event's param_block.
+    };
+
+    /**
+     * A %chunk is the header of a block of memory from which param_blocks are
+     * allocated.
+     */
+    struct alignas(std::max_align_t) chunk {
+      chunk      *next_;                ///< The next chunk, if any.
+      std::size_t size_;                ///< Number of bytes after the header.
+    };
+
+    std::vector<entry>  entries_;       ///< The events in this batch.
+    chunk              *chunks_;        ///< All chunks, if any.
+    chunk              *cur_chunk_;     ///< Chunk being allocated from.
+    std::size_t         cur_used_;      ///< Bytes used in cur_chunk_.
+
+    /**
+     * Allocates storage for a param_block.
      *
-     * @return Returns the iterator positioned at the next state, if any.
+     * @param size The size of the param_block.
+     * @return Returns storage aligned to `std::max_align_t`.
      */
-    const_iterator& operator++() {
-      return ++c_, *this;
+    void* allocate( std::size_t size );
+
+    /**
+     * Removes all events from this %batch but without destroying their
+     * param_blocks since they've been destroyed by having been broadcast.
+     */
+    void reset();
+
+    friend class machine;
+  };
+
+  /**
+   * Broadcasts all the events in a batch under a single lock of this
+   * %machine.  The preconditions of all the events are evaluated and their
+   * transitions found first; then the transitions of all of them are taken
+   * together in a single micro-step.  However, if an %event occurs more than
+   * once in a batch, each subsequent occurrence is deferred to the next
+   * micro-step.  Upon return, the batch is empty.
+   *
+   * @param b The batch to broadcast.
+   * @note This must not be called from within one of the %machine's own
+   * actions.
+   */
+  void broadcast_batch( batch &b );
+
+  /**
+   * A %ticket identifies a posted %event.  It can be used to check for or wait
+   * for the completion of the micro-steps caused by the %event.
+   */
+  typedef std::size_t ticket;
+
+  /**
+   * Posts an %event to a %machine's inbox.  Unlike broadcasting an %event
+   * directly, posting never blocks on the %machine's mutex: the %event and its
+   * parameters are copied into a lock-free inbox and the function returns.
+   * Posted events are broadcast in the order posted.
+   *
+   * If the %machine has an executor, the executor is asked to run the
+   * %machine; otherwise, posted events are broadcast either by the posting
+   * thread itself (if the %machine is idle) or by whichever thread currently
+   * holds the %machine's mutex just before it releases it.
+   *
+   * Without an executor, then, posting runs the transition algorithm inline:
+   * the thread that broadcasts posted events keeps doing so until the inbox
+   * is empty, including events other threads post in the meantime, since
+   * those threads returned counting on it to.  Under sustained load, that
+   * thread's call may not return for a long time and it runs every action.
+   * To keep the latency of posting independent of how long actions run,
+   * bind the %machine to an executor, e.g., via start_thread().
+   *
+   * For example, given `event alpha(int n);`:
+   * @code
+   *  m.wait( m.post( m.alpha, 42 ) );
+   * @endcode
+   *
+   * @tparam EventClass The class of the %event to post.
+   * @tparam Args The types of the %event's parameters.
+   * @param e The %event to post.
+   * @param args The %event's parameters, if any.
+   * @return Returns a ticket for the posted %event.
+   * @note If the inbox is full, this blocks until there is room.  Hence, this
+   * must not be called from within one of the %machine's own actions when the
+   * inbox may be full.
+   */
+  template<class EventClass,typename... Args>
+  ticket post( EventClass &e, Args&&... args );
+
+  /**
+   * Gets whether the micro-steps caused by a posted %event have completed.
+   *
+   * @param t The ticket returned by post().
+   * @return Returns `true` only if they have.
+   */
+  bool is_done( ticket t ) const;
+
+  /**
+   * Waits for the micro-steps caused by a posted %event to complete.
+   *
+   * @param t The ticket returned by post().
+   * @note This must not be called either from within one of the %machine's
+   * own actions or from the thread of its executor.
+   */
+  void wait( ticket t ) const;
+
+  /**
+   * Gets the executor this %machine is bound to, if any.
+   *
+   * @return Returns said executor or null if none.
+   */
+  executor* executor_of() const {
+    return executor_.load( std::memory_order_acquire );
+  }
+
+  /**
+   * Binds this %machine to an executor.  Once bound, events posted via post()
+   * are broadcast only by the executor calling run_posted() and never by the
+   * posting thread.
+   *
+   * @param e The executor to bind to or null to unbind.
+   * @return Returns the previous executor, if any.
+   * @note The executor must outlive the binding.  Before a bound %machine is
+   * destroyed, it must be unbound: unbinding waits until the previous
+   * executor is no longer running it.  Hence, this must not be called from
+   * within one of the %machine's own actions.
+   */
+  executor* set_executor( executor *e );
+
+  /**
+   * Gets this %machine's lock policy.
+   *
+   * @return Returns said policy.
+   */
+  lock_policy lock_policy_of() const noexcept {
+    return mutex_.policy();
+  }
+
+  /**
+   * Sets how (or whether) this %machine's mutex is locked.  For machines that
+   * are confined to a single thread, lock_policy::NONE elides all locking when
+   * broadcasting.
+   *
+   * @param p The new policy.
+   * @note This must be called only before the %machine is used, i.e., before
+   * it's entered, bound to an executor, or any %event is broadcast or posted
+   * to it, and never while another thread may be using it.
+   */
+  void set_lock_policy( lock_policy p );
+
+  /**
+   * Starts a thread owned by this %machine and binds to it as its executor so
+   * that all posted events are broadcast on that thread.
+   */
+  void start_thread();
+
+  /**
+   * Stops the thread started by start_thread(), if any, after it has
+   * broadcast all events posted so far.  Its executor is destroyed only once
+   * no thread posting to this %machine can still use it.  This must be called
+   * before the %machine is destroyed.
+   */
+  void stop_thread();
+
+  /**
+   * Broadcasts all events that have been posted so far.  This is meant to be
+   * called only by an executor.
+   */
+  void run_posted();
+
+  // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+protected:
+  /**
+   * Constructs a %machine.
+   *
+   * When deriving a class from %machine, the macros `CHSM_MACHINE_ARGS` and
+   * `CHSM_MACHINE_INIT` can be used to avoid having to deal with the many
+   * constructor arguments, e.g.:
+   * @code
+   *  class my_machine : public CHSM::machine {
+   *  public:
+   *    my_machine( CHSM_MACHINE_ARGS ) : 
+   *      CHSM::machine{ CHSM_MACHINE_INIT } {
+   *      // ...
+   *    }
+   *    // ...
+   *  };
+   * @endcode
+   */
+  machine( CHSM_MACHINE_ARGS );
+
+private:
+  /**
+   * An %event_queue is the FIFO queue of events that have been broadcasted.
+   * Unlike a ring buffer, its events are always contiguous so that the events
+   * of a micro-step can be iterated over as a flat array; the space of events
+   * at the front is reclaimed either when the queue becomes empty (which is
+   * what usually happens at the end of the transition algorithm) or when it
+   * has to make room at the back.  Events are stored in place up to
+   * `CHSM_EVENT_QUEUE_CAPACITY`; after that, the capacity doubles as needed.
+   */
+  class event_queue {
+  public:
+    typedef unsigned size_type;
+
+    event_queue() :
+      buf_{ inline_buf_ }, capacity_{ CHSM_EVENT_QUEUE_CAPACITY },
+      head_{ 0 }, tail_{ 0 }
+    {
+    }
+
+    ~event_queue() {
+      if ( buf_ != inline_buf_ )
+        delete[] buf_;
     }
 
     /**
-     * Post-increments the iterator.
+     * Gets the event at the given position relative to the front.  Since
+     * pushing an event may move all the events, positions must be used rather
+     * than pointers across calls to push_back().
      *
-     * @return Returns a new iterator positioned at the state the original
-     * iterator was positioned at prior to the increment.
+     * @param i The position.
+     * @return Returns said event.
      */
-    const_iterator operator++(int) {
-      return const_iterator{ p_, c_++ };
+    event* operator[]( size_type i ) const {
+      return buf_[ head_ + i ];
     }
 
     /**
-     * Compares two iterators for equality.
+     * Gets the events, front to back, as a contiguous array.
      *
-     * @param i The first iterator.
-     * @param j The second iterator.
-     * @return Returns `true` only if the two iterators are positioned at the
-     * same state.
+     * @return Returns a pointer to the front event.
      */
-    friend bool operator==( const_iterator const &i, const_iterator const &j ) {
-      return *i.c_ == *j.c_;
+    event *const* data() const {
+      return buf_ + head_;
+    }
+
+    bool empty() const {
+      return head_ == tail_;
     }
 
-    /**
-     * Compares two iterators for inequality.
-     *
-     * @param i The first iterator.
-     * @param j The second iterator.
-     * @return Returns `true` only if the two iterators are not positioned at
-     * the same state.
-     */
-    friend bool operator!=( const_iterator const &i, const_iterator const &j ) {
-      return !(i == j);
-    }
+    /**
+     * Removes events from the front.
+     *
+     * @param n The number of events to remove.
+     */
+    void pop_front( size_type n ) {
+      head_ += n;
+      if ( head_ == tail_ )
+        head_ = tail_ = 0;
+    }
+
+    void push_back( event *e ) {
+      if ( tail_ == capacity_ )
+        make_room();
+      buf_[ tail_++ ] = e;
+    }
+
+    size_type size() const {
+      return tail_ - head_;
+    }
+
+  private:
+    event_queue( event_queue const& ) = delete;
+    event_queue& operator=( event_queue const& ) = delete;
+
+    /**
+     * Makes room at the back by either reclaiming the space at the front or
+     * doubling the capacity.
+     */
+    void make_room();
+
+    event   **buf_;                     ///< Either inline_buf_ or the heap.
+    size_type capacity_;                ///< Capacity of buf_.
+    size_type head_;                    ///< Position of the front event.
+    size_type tail_;                    ///< Position one past the back event.
+    event    *inline_buf_[ CHSM_EVENT_QUEUE_CAPACITY ];
+  };
+
+  /**
+   * The entire set of states in the machine.  This is built and set by the
+   * CHSM-to-C++ compiler.
+   */
+  state *const *const state_;
+
+  /**
+   * The outermost cluster encompassing the entire machine.
+   */
+  cluster &root_;
+
+  /**
+   * The entire set of transitions in the machine.  This is built and set by
+   * the CHSM-to-C++ compiler.
+   */
+  transition const *const transition_;
+
+  /**
+   * The number of transitions in the machine.  This is set by the CHSM-to-C++
+   * compiler.
+   */
+  unsigned const transitions_in_machine_;
+
+  /**
+   * An array to pointers to events indexed by transition::id.  It's used to
+   * mark a transition as "taken" so it's taken at most once per transition
+   * algorithm execution for a given event.
+   */
+  event const **const taken_;
+
+  /**
+   * An array of pointers to states indexed by state::id.  It's used store the
+   * states to transition to for a given transition.
+   */
+  state **const target_;
+
+  /**
+   * The bitset of the states that are active.  It's kept up-to-date by
+   * state::enter() and state::exit().  It's initially the array emitted by
+   * the CHSM-to-C++ compiler, but a fleet moves it into its own storage.
+   */
+  config_word *config_;
+
+  /**
+   * The number of words in config_.  This is set by the CHSM-to-C++
+   * compiler.
+   */
+  unsigned const config_words_;
+
+  /**
+   * The sequence number of the publications of config_ into published_: it's
+   * 2<i>n</i> while publication <i>n</i> is the most recent and
+   * 2<i>n</i>+1 while publication <i>n</i>+1 is being written.
+   */
+  std::atomic<std::uint64_t> config_seq_;
+
+  /**
+   * Two buffers of config_words_ words each: publication <i>n</i> of config_
+   * is written into buffer <i>n</i> % 2.
+   */
+  std::atomic<config_word> *const published_;
+
+  struct config_waiters;
+
+  /**
+   * The threads waiting in wait_until_any(), if any.  It's created only upon
+   * the first wait.
+   */
+  std::atomic<config_waiters*> config_waiters_;
+
+  /**
+   * Publishes config_ for published_config().  This must be called only by
+   * the thread that holds the %machine's mutex.
+   */
+  void publish_config();
+
+  /**
+   * Reads the most recent publication of config_.
+   *
+   * @tparam ReadFn The type of \a read.
+   * @param read The function that reads a buffer of published_.  It may be
+   * called more than once if the buffer is overwritten while reading it.
+   */
+  template<class ReadFn>
+  void read_published( ReadFn read ) const;
+
+  /**
+   * Gets whether a state was active in the most recent publication of
+   * config_.
+   *
+   * @param id The ID of the state.  For the root cluster (whose ID is -1),
+   * it's whether any state was active.
+   * @return Returns `true` only if it was.
+   */
+  bool published_active( state::id id ) const;
+
+  /**
+   * Gets whether any of the states in a bitset are active.
+   *
+   * @param states The bitset of states having config_words_ words.
+   * @return Returns `true` only if at least one is active.
+   */
+  bool is_any_active( config_word const *states ) const {
+    for ( unsigned i = 0; i < config_words_; ++i )
+      if ( (config_[i] & states[i]) != 0 )
+        return true;
+    return false;
+  }
+
+  /**
+   * Sets whether a state is active in config_.
+   *
+   * @param id The ID of the state.  The root cluster (whose ID is -1) isn't
+   * in config_.
+   * @param is_active Whether the state is active.
+   */
+  void set_active( state::id id, bool is_active ) {
+    if ( id < 0 )
+      return;
+    config_word &word = config_[ id / CHSM_CONFIG_WORD_BITS ];
+    config_word const bit = config_word{ 1 } << id % CHSM_CONFIG_WORD_BITS;
+    if ( is_active )
+      word |= bit;
+    else
+      word &= ~bit;
+  }
+
+  /**
+   * This is `true` only when the transition algorithm is in progress and is
+   * used to prevent recursive calls.
+   */
+  bool in_progress_;
+
+  event_queue event_queue_;             ///< Events that have been broadcasted.
+  unsigned    debug_indent_;            ///< Current debugging indentation.
+  debug_mask  debug_state_;             ///< Current debugging state.
+  event      *events_;                  ///< This machine's events.
+
+#ifndef CHSM_NO_METRICS
+  metric  micro_steps_;                 ///< Micro-steps performed.
+  metric  micro_step_events_;           ///< Events in all micro-steps.
+  metric  max_micro_step_events_;       ///< Most events in a micro-step.
+  metric *transitions_taken_;           ///< Taken, by transition ID.
+
+  /**
+   * The time (in nanoseconds) the clock was last read: either at the end of
+   * the last micro-step or when an event was broadcast while the transition
+   * algorithm wasn't in progress.
+   */
+  std::uint64_t clock_ns_;
+
+  bool record_latency_;                 ///< Record event latencies?
+
+  /**
+   * Reads the clock.
+   *
+   * @return Returns the time in nanoseconds since some arbitrary epoch.
+   */
+  static std::uint64_t read_clock_ns();
+#endif /* CHSM_NO_METRICS */
+
+  /**
+   * A %trace_slot is a slot in the trace ring buffer.  A record is copied
+   * into and out of it a word at a time so that trace_records() can read the
+   * ring without locking while records are being written.  The slot's
+   * sequence number tells a reader whether the words it read are those of
+   * the one record it expected: it's 2n+1 while record n is being written and
+   * 2n+2 once it has been.
+   */
+  struct trace_slot {
+    std::atomic<std::uint64_t>  seq_;   ///< Sequence number.
+    std::atomic<std::uint64_t>  words_[ (sizeof( trace_record ) + 7) / 8 ];
+  };
+
+  trace_slot   *trace_buf_;             ///< Trace ring buffer, if any.
+  size_t        trace_mask_;            ///< Ring capacity - 1.
+  std::atomic<std::uint64_t> trace_head_; ///< Total records ever started.
+
+  /**
+   * Gets whether either any debugging state is set or trace records are being
+   * recorded.
+   *
+   * @return Returns `true` only if so.
+   */
+  bool is_tracing() const {
+#if defined CHSM_NO_DEBUG && defined CHSM_NO_TRACE
+    return false;
+#elif defined CHSM_NO_DEBUG
+    return trace_buf_ != nullptr;
+#elif defined CHSM_NO_TRACE
+    return debug_state_ != DEBUG_NONE;
+#else
+    return debug_state_ != DEBUG_NONE || trace_buf_ != nullptr;
+#endif /* CHSM_NO_DEBUG */
+  }
+
+  /**
+   * Records a trace record, if recording, and prints it, if its debugging
+   * state is set.  It should be called only if is_tracing().
+   *
+   * @param kind The kind of record.
+   * @param e The event, if any.
+   * @param value The transition ID, count, or flag, if any.
+   * @param sid The state ID, if any.
+   */
+  void emit_trace( trace_kind kind, event const *e,
+                   transition::id value = -1, state::id sid = -1 );
+
+  class inbox;
+
+  /**
+   * An %inbox_entry is a single slot in the inbox of posted events.
+   */
+  struct inbox_entry {
+    std::atomic<std::size_t> seq_;      ///< Slot sequence number.
+    event *event_;                      ///< Event posted, if any.
+    void  *param_block_;                ///< The event's param_block.
+    void  *heap_;                       ///< Non-null only if heap-allocated.
+
+    /**
+     * In-place storage for a param_block.
+     */
+    alignas(std::max_align_t) char storage_[ CHSM_INBOX_BLOCK_SIZE ];
+  };
+
+  /**
+   * The inbox of events posted via post(), if any.  It's created only upon
+   * the first post.
+   */
+  std::atomic<inbox*> inbox_;
+
+  std::atomic<executor*> executor_;     ///< The bound executor, if any.
+  thread_executor *own_executor_;       ///< Executor for start_thread().
+
+  /**
+   * This is `true` only when the executor has been asked to run this %machine
+   * but hasn't yet called run_posted().
+   */
+  std::atomic<bool> scheduled_;
+
+  /**
+   * The number of calls to run_posted() in progress.  (There can be more
+   * than one only while switching executors.)
+   */
+  std::atomic<unsigned> running_;
+
+  /**
+   * The number of threads in ask_executor() that may be using the executor
+   * they loaded.  Unbinding waits for it to be 0 so that no thread can use an
+   * executor once it's been unbound.
+   */
+  std::atomic<unsigned> asking_;
+
+  /**
+   * Asks the bound executor, if any, to run this %machine unless it has
+   * already been asked to.
+   *
+   * @return Returns `true` only if an executor is bound.
+   */
+  bool ask_executor();
+
+  /**
+   * Waits until no thread can still use the executor this %machine was just
+   * unbound from and that executor is no longer running this %machine,
+   * including any run it has been asked to do but hasn't started yet.
+   */
+  void wait_for_unbound_executor();
+
+  /**
+   * Gets the inbox, creating it if necessary.
+   *
+   * @return Returns said inbox.
+   */
+  inbox* inbox_of();
+
+  /**
+   * Claims an entry in the inbox for a posted event.  If the inbox is full,
+   * waits for the consumer to free an entry.
+   *
+   * @return Returns said entry.
+   */
+  inbox_entry* inbox_claim();
+
+  /**
+   * Publishes a previously claimed inbox entry and then either asks the
+   * executor to run this %machine or attempts to drain the inbox itself.
+   *
+   * @param entry The entry to publish.
+   * @return Returns the entry's ticket.
+   */
+  ticket inbox_publish( inbox_entry *entry );
+
+  /**
+   * Posts an expired timeout event.  Unlike post(), this neither waits for
+   * room if the inbox is full nor broadcasts the event: it only asks the
+   * executor, if any, to run this %machine.  If there is none, it's up to the
+   * caller to call drain_inbox().
+   *
+   * @param t The timeout event.
+   * @param generation The generation of the arming that expired.
+   * @return Returns `false` only if the inbox is full.
+   */
+  bool post_timeout( timeout_event &t, std::uint64_t generation );
+
+  /**
+   * Broadcasts all posted events, but only if the inbox isn't empty, the
+   * %machine isn't bound to an executor, the %machine's mutex can be acquired
+   * without blocking, and the transition algorithm isn't already in progress.
+   * This is `const` so that event::machine_lock can guard `const` member
+   * functions: posted events are broadcast via their own non-`const`
+   * pointers.
+   */
+  void drain_inbox() const {
+    if ( inbox_.load( std::memory_order_acquire ) != nullptr )
+      drain_inbox_slow();
+  }
+
+  /**
+   * Helper for drain_inbox() that does the actual draining.
+   */
+  void drain_inbox_slow() const;
+
+  /**
+   * Broadcasts all posted events.  The %machine's mutex must be held and the
+   * transition algorithm must not be in progress.
+   *
+   * @param ib The inbox to drain.
+   */
+  void drain_inbox_locked( inbox *ib ) const;
+
+  static state const *const NIL_;       ///< Sentinel for end().
+  static state::id const    NO_STATE_ID_; ///< Used by internal transitions.
+
+  /**
+   * Performs all the transitions for all events queued.
+   */
+  void algorithm();
+
+  /**
+   * Enters the states of a transition's precomputed enter path.
+   *
+   * @param trigger The event that caused the transition.
+   * @param path The IDs of the states to enter terminated by -1.
+   */
+  void enter_path( event const &trigger, state::id const *path );
+
+  /**
+   * Exits a transition's "from" state and then the states of its precomputed
+   * exit path.
+   *
+   * @param trigger The event that caused the transition.
+   * @param from The state to exit.
+   * @param path The IDs of the ancestors of \a from to exit terminated by -1.
+   * @return Returns `true` only if \a from was exited.
+   */
+  bool exit_path( event const &trigger, state *from, state::id const *path );
+
+  /**
+   * @internal
+   *
+   * Emits the debugging preamble, including indenting the current number of
+   * spaces.
+   *
+   * @return Returns the stream to continue emitting debugging information to.
+   */
+  std::ostream& dout() const;
+
+  friend class event;
+  friend class fleet_base;
+  friend class parent;
+  friend class state;
+  friend class timer_wheel;
+  friend struct transition;
+
+  mutable mutex_type mutex_;
+  friend struct event::machine_lock;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A %parent \e is-an abstract state that has child states.
+ *
+ * It is an implementation detail to factor common data members and member
+ * functions for the CHSM::cluster and CHSM::set classes.
+ *
+ * @author Paul J. Lucas
+ */
+class parent : public state {
+protected:
+  /**
+   * @internal
+   *
+   * The array of state IDs that are the child states.
+   */
+  typedef id const* child_list;
+
+public:
+# define  CHSM_PARENT_ARG_LIST(A)     \
+          CHSM_STATE_ARG_LIST(A)
+
+  /**
+   * Defines the constructor arguments for the CHSM::parent class.
+   *
+   * @hideinitializer
+   */
+# define CHSM_PARENT_ARGS         CHSM_PARENT_ARG_LIST(CHSM_FORMAL)
+
+  /**
+   * Defines the base-class constructor argument \e mem-initializers for the
+   * CHSM::parent class.
+   *
+   * @hideinitializer
+   */
+# define CHSM_PARENT_INIT         CHSM_PARENT_ARG_LIST(CHSM_ACTUAL)
+
+  /** The type of the value returned by iterator and const_iterator. */
+  typedef state value_type;
+
+  /** A pointer to a `value_type`. */
+  typedef value_type* pointer;
+
+  /** A pointer to a `const value_type`. */
+  typedef value_type const* const_pointer;
+
+  /** A reference to a `value_type`. */
+  typedef value_type& reference;
+
+  /** A reference to a `const value_type`. */
+  typedef value_type const& const_reference;
+
+  /**
+   * Clears this parent's history.  However, since parents don't have a
+   * history, there is nothing to do for them; however, calls `deep_clear()`
+   * for all child states.
+   */
+  void deep_clear() override;
+
+  /**
+   * Returns whether this parent has no child states.
+   *
+   * @return Returns `true` only if this parent has no child states.
+   */
+  bool empty() const {
+    return *desc_.children_ == NO_CHILD_ID_;
+  }
+
+  /**
+   * Returns a parent::reference to the first child state.
+   *
+   * @return Returns said reference.
+   */
+  reference front() {
+    return *(machine_.state_)[ *desc_.children_ ];
+  }
+
+  /**
+   * Returns a parent::const_reference to the first child state.
+   *
+   * @return Returns said reference.
+   */
+  const_reference front() const {
+    return *(machine_.state_)[ *desc_.children_ ];
+  }
+
+  class iterator;
+  friend class iterator;
+
+  /**
+   * This is an iterator in "STL style" to iterate over the child states of a
+   * parent state.
+   */
+  class iterator {
+  public:
+    /**
+     * Constructs an %iterator.
+     */
+    iterator() { }
+
+    /**
+     * Returns a parent::reference to the state the %iterator is positioned at.
+     *
+     * @return Returns said reference.
+     */
+    reference operator*() const {
+      return *p_[ *c_ ];
+    }
+
+    /**
+     * Returns a parent::pointer to the state the %iterator is positioned at.
+     *
+     * @return Returns said pointer.
+     */
+    pointer operator->() const {
+      return p_[ *c_ ];
+    }
+
+    /**
+     * Pre-increments the %iterator.
+     *
+     * @return Returns the %iterator positioned at the next state, if any.
+     */
+    iterator& operator++() {
+      return ++c_, *this;
+    }
+
+    /**
+     * Post-increments the %iterator.
+     *
+     * @return Returns a new %iterator positioned at the state the original
+     * %iterator was positioned at prior to the increment.
+     */
+    iterator operator++(int) {
+      return iterator( p_, c_++ );
+    }
+
+    /**
+     * Compares two iterators for equality.
+     *
+     * @param i The first %iterator.
+     * @param j The second %iterator.
+     * @return Returns `true` only if the two iterators are positioned at
+     * the same state.
+     */
+    friend bool operator==( iterator const &i, iterator const &j ) {
+      return *i.c_ == *j.c_;
+    }
+
+    /**
+     * Compares two iterators for inequality.
+     *
+     * @param i The first %iterator.
+     * @param j The second %iterator.
+     * @return Returns `true` only if the two iterators are not positioned at
+     * the same state.
+     */
+    friend bool operator!=( iterator const &i, iterator const &j ) {
+      return !(i == j);
+    }
+
+  protected:
+    pointer const  *p_;
+    child_list      c_;
+
+    iterator( pointer const *p, child_list c ) : p_{ p }, c_{ c } { }
+
+    friend class parent;
+  };
+
+  /**
+   * Returns a parent::iterator positioned at the first child state of a
+   * parent.
+   *
+   * @return Returns said iterator.
+   */
+  iterator begin() {
+    return iterator{ machine_.state_, desc_.children_ };
+  }
+
+  /**
+   * Returns a parent::iterator positioned at one past the last child state of
+   * a parent.
+   *
+   * @return Returns said iterator.
+   */
+  iterator end() {
+    return iterator{ nullptr, &NO_CHILD_ID_ };
+  }
+
+  class const_iterator;
+  friend class const_iterator;
+
+  /**
+   * This is an iterator in "STL style" to iterate over the child states of a
+   * parent state.
+   */
+  class const_iterator {
+  public:
+    /**
+     * Constructs a %const_iterator.
+     */
+    const_iterator() { }
+
+    /**
+     * Returns a parent::const_reference to the state the iterator is
+     * positioned at.
+     *
+     * @return Returns said reference.
+     */
+    const_reference operator*() const {
+      return *p_[ *c_ ];
+    }
+
+    /**
+     * Returns a parent::const_pointer to the state the iterator is positioned
+     * at.
+     *
+     * @return Returns said reference.
+     */
+    const_pointer operator->() const {
+      return p_[ *c_ ];
+    }
+
+    /**
+     * Pre-increments the iterator.
+     *
+     * @return Returns the iterator positioned at the next state, if any.
+     */
+    const_iterator& operator++() {
+      return ++c_, *this;
+    }
+
+    /**
+     * Post-increments the iterator.
+     *
+     * @return Returns a new iterator positioned at the state the original
+     * iterator was positioned at prior to the increment.
+     */
+    const_iterator operator++(int) {
+      return const_iterator{ p_, c_++ };
+    }
+
+    /**
+     * Compares two iterators for equality.
+     *
+     * @param i The first iterator.
+     * @param j The second iterator.
+     * @return Returns `true` only if the two iterators are positioned at the
+     * same state.
+     */
+    friend bool operator==( const_iterator const &i, const_iterator const &j ) {
+      return *i.c_ == *j.c_;
+    }
+
+    /**
+     * Compares two iterators for inequality.
+     *
+     * @param i The first iterator.
+     * @param j The second iterator.
+     * @return Returns `true` only if the two iterators are not positioned at
+     * the same state.
+     */
+    friend bool operator!=( const_iterator const &i, const_iterator const &j ) {
+      return !(i == j);
+    }
+
+  protected:
+    pointer const  *p_;
+    child_list      c_;
+
+    const_iterator( pointer const *p, child_list c ) : p_{ p }, c_{ c } { }
+
+    friend class parent;
+  };
+
+  /**
+   * Returns a parent::const_iterator positioned at the first child state of a
+   * parent.
+   *
+   * @return Returns said iterator.
+   */
+  const_iterator begin() const {
+    return const_iterator{ machine_.state_, desc_.children_ };
+  }
+
+  /**
+   * Returns a parent::const_iterator positioned at one past the last child
+   * state of a parent.
+   *
+   * @return Returns said iterator.
+   */
+  const_iterator end() const {
+    return const_iterator{ nullptr, &NO_CHILD_ID_ };
+  }
+
+  // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+protected:
+  /**
+   * @internal
+   *
+   * Constructs a parent.
+   */
+  parent( CHSM_PARENT_ARGS ) : state{ CHSM_STATE_INIT } { }
+
+  /**
+   * @internal
+   *
+   * Requests that an inactive child state become the active child of its
+   * parent state.
+   *
+   * @param child The child state requesting permission to become the active
+   * child.
+   * @return Returns `true` by default.
+   */
+  virtual bool switch_active_child_to( state *child );
+
+  // for access to switch_active_child_to()
+  friend bool state::enter( event const&, state* );
+
+private:
+  parent( parent const& ) = delete;
+  parent& operator=( parent const& ) = delete;
+
+  static id const   NO_CHILD_ID_;       ///< Sentinel for end().
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A %cluster \e is-a CHSM::parent that can have at most one child-state active
+ * at any given time.
+ *
+ * A %cluster may have a history.  If a %cluster does not have a history, or it
+ * does have a history but has not previously been active, then the child-state
+ * entered after it itself is entered is the \e default child-state; if a
+ * %cluster does have a history and it has been visited before, then the child-
+ * state entered after it itself is entered is the one that was last active.
+ *
+ * A %cluster may alternatively have a \e deep history.  Such a %cluster
+ * behaves exactly as one with an ordinary history; the difference is that all
+ * clusters lexically-enclosed by it in the CHSM description also have a
+ * history.
+ *
+ * The %cluster class can be extended either to add additional data members and
+ * member functions, or to alter its behavior upon being entered or exited.
+ *
+ * @author Paul J. Lucas
+ */
+class cluster : public parent {
+public:
+# define  CHSM_CLUSTER_ARG_LIST(A) \
+          CHSM_PARENT_ARG_LIST(A)
+
+  /**
+   * Defines the constructor arguments for the CHSM::cluster class.
+   *
+   * @hideinitializer
+   */
+# define  CHSM_CLUSTER_ARGS       CHSM_CLUSTER_ARG_LIST(CHSM_FORMAL)
+
+  /**
+   * Defines the base-class constructor argument \e mem-initializers for the
+   * CHSM::cluster class.
+   *
+   * @hideinitializer
+   */
+# define  CHSM_CLUSTER_INIT       CHSM_CLUSTER_ARG_LIST(CHSM_ACTUAL)
+
+  /**
+   * Constructs a cluster.
+   *
+   * When deriving a class from %cluster, the macros `CHSM_CLUSTER_ARGS` and
+   * `CHSM_CLUSTER_INIT` can be used to avoid having to deal with the many
+   * constructor arguments.  See CHSM::state for an example.
+   */
+  cluster( CHSM_CLUSTER_ARGS );
+
+  /**
+   * Clears the history.
+   */
+  void clear() {
+    last_child_ = &front();
+  }
+
+  /**
+   * Clears the history, if any; then clear all child cluster's history, if
+   * any.
+   */
+  void deep_clear() override;
+
+  /**
+   * Enters a %cluster via a transition and also enter one of its child states.
+   *
+   * @param trigger The event that triggered the transition.
+   * @param from_child If not null, this child state of the cluster is being
+   * entered directly.
+   * @return Returns `true` only if the %cluster was actually entered, i.e., it
+   * wasn't already active.
+   */
+  bool enter( event const &trigger, state *from_child = nullptr ) override;
+
+  /**
+   * Exits a %cluster via a transition, but first exit its active child state.
+   *
+   * @param trigger The event that triggered the transition.
+   * @param to The state that is being transitioned to.
+   * @return Returns `true` only if the %cluster actually exited, i.e., it was
+   * active.
+   */
+  bool exit( event const &trigger, state *to = nullptr ) override;
+
+  // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+private:
+  cluster( cluster const& ) = delete;
+  cluster& operator=( cluster const& ) = delete;
+
+  bool switch_active_child_to( state *child ) override;
+
+  state      *active_child_;            ///< Currently active child, if any.
+  state      *last_child_;              ///< Last active child, if any.
+
+  friend class machine;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A %set \e is-a CHSM::parent that has either all or no child-states active.
+ * All child-states are entered after and exited before their parent-state.
+ * The order that child-states are entered and exited is undefined.
+ *
+ * The %set class can be extended either to add additional data members and
+ * member functions, or to alter its behavior upon being entered or exited.
+ *
+ * @author Paul J. Lucas
+ */
+class set : public parent {
+public:
+# define  CHSM_SET_ARG_LIST(A) \
+          CHSM_PARENT_ARG_LIST(A)
+
+  /**
+   * Defines the constructor arguments for the CHSM::set class.
+   *
+   * @hideinitializer
+   */
+# define  CHSM_SET_ARGS   CHSM_SET_ARG_LIST(CHSM_FORMAL)
+
+  /**
+   * Defines the base-class constructor argument \e mem-initializers for the
+   * CHSM::set class.
+   *
+   * @hideinitializer
+   */
+# define  CHSM_SET_INIT   CHSM_SET_ARG_LIST(CHSM_ACTUAL)
+
+  /**
+   * Constructs a %set.
+   *
+   * When deriving a class from %set, the macros `CHSM_SET_ARGS` and
+   * `CHSM_SET_INIT` can be used to avoid having to deal with the many
+   * constructor arguments.  See CHSM::state for an example.
+   */
+  set( CHSM_SET_ARGS ) : parent{ CHSM_PARENT_INIT } { }
+
+  /**
+   * Enters a %set via a transition and also enters all of its child states.
+   *
+   * @param trigger The event that triggered the transition.
+   * @param from_child Not used here.
+   * @return Returns `true` only if the %set was actually entered, i.e., it
+   * wasn't already active.
+   */
+  bool enter( event const &trigger, state *from_child = nullptr ) override;
+
+  /**
+   * Exits a %set via a transition, but first exits all of its child states.
+   *
+   * @param trigger The event that triggered the transition.
+   * @param to The state we are transitioning to.
+   * @return Returns `true` only if the %set actually exited, i.e., it was
+   * active.
+   */
+  bool exit( event const &trigger, state *to = nullptr ) override;
+
+  set( set const& ) = delete;
+  set& operator=( set const& ) = delete;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A %timeout_event \e is-an event that is broadcast automatically a given
+ * delay after its state is entered unless that state is exited first.  It's
+ * emitted by the CHSM-to-C++ compiler for each event of the form:
+ * @code
+ *  after( 250ms ) -> s;
+ * @endcode
+ *
+ * The timeouts of all machines share a single timer wheel so that there is no
+ * thread per timeout.  Arming (upon entering the state) and cancelling (upon
+ * exiting it) take O(1) time.  When a timeout expires, the timer wheel's
+ * thread (or, while there is a simulator, simulator::run()) posts the event to
+ * its machine, but never broadcasts it itself: if the machine is bound to an
+ * executor, the event is broadcast on one of the executor's threads;
+ * otherwise, it's broadcast by a second thread of the timer wheel that runs
+ * all such machines (or, while there is a simulator, by simulator::run()).
+ * Hence a slow action of a machine not bound to an executor delays the
+ * timeouts of other such machines, but never those of bound machines.
+ *
+ * @author Paul J. Lucas
+ */
+class timeout_event : public event {
+public:
+  /**
+   * A %delay is a function (machine member function) that returns how long
+   * after its state is entered a %timeout_event is to be broadcast.  It's
+   * called each time the state is entered.
+   *
+   * @return Returns said delay.  Delays are rounded up to the timer wheel's
+   * tick of `CHSM_TIMER_TICK_US` microseconds.
+   */
+  typedef std::chrono::nanoseconds (machine::*delay)() const;
+
+  /**
+   * Constructs a %timeout_event.
+   *
+   * @param chsm_state_ The state that arms this %timeout_event upon being
+   * entered and cancels it upon being exited.
+   * @param chsm_delay_ The function that returns the delay.
+   */
+  timeout_event( CHSM_EVENT_ARGS, state &chsm_state_, delay chsm_delay_ );
+
+  /**
+   * Destroys a %timeout_event.  If it's armed, it's cancelled first.
+   */
+  ~timeout_event();
+
+  // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+protected:
+  /**
+   * @internal
+   *
+   * A %param_block for a %timeout_event holds the arming it was posted for.
+   */
+  struct param_block : event::param_block {
+    /**
+     * Constructs a %param_block.
+     *
+     * @param e The event to be a parameter block for.
+     * @param generation The generation of the arming that expired.
+     */
+    param_block( event const &e, std::uint64_t generation ) :
+      event::param_block{ e }, chsm_generation_{ generation }
+    {
+    }
+
+  protected:
+    /**
+     * The precondition is `true` only if the arming that expired is still the
+     * current one, i.e., the state hasn't been exited (and possibly entered
+     * again) since.
+     *
+     * @return Returns `true` only if the expiry isn't stale.
+     */
+    bool precondition() const override;
+
+    std::uint64_t const chsm_generation_; ///< Generation of the arming.
+  };
+
+private:
+  state        &state_;                 ///< State that arms us.
+  delay const   delay_;                 ///< Returns the delay.
+  timeout_event *next_timeout_;         ///< Next timeout of state_, if any.
+
+  //
+  // The data members below are guarded by the timer wheel's mutex except that
+  // generation_ is written only while the machine's mutex is held too.
+  //
+  timeout_event  *wheel_next_;          ///< Next in slot, if any.
+  timeout_event **wheel_pprev_;         ///< Pointer to us; null if unarmed.
+  std::uint64_t   expiry_;              ///< Tick to expire at.
+
+  /**
+   * Incremented each time we're armed or cancelled so an expiry that's posted
+   * just before being cancelled can be recognized as stale.
+   */
+  std::uint64_t generation_;
+
+  /**
+   * Arms this %timeout_event.
+   */
+  void arm();
+
+  /**
+   * Cancels this %timeout_event.
+   */
+  void cancel();
+
+  timeout_event( timeout_event const& ) = delete;
+  timeout_event& operator=( timeout_event const& ) = delete;
+
+  friend class machine;
+  friend class state;
+  friend class timer_wheel;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * An %executor runs machines on its own thread(s) so that threads posting
+ * events to machines need not run them.  A machine is bound to an %executor
+ * via machine::set_executor().
+ *
+ * @author Paul J. Lucas
+ */
+class executor {
+public:
+  /**
+   * Destroys an %executor.
+   */
+  virtual ~executor();
+
+  /**
+   * Requests that machine::run_posted() be called for the given machine on
+   * one of this %executor's threads (eventually).  A machine requests this at
+   * most once until the resulting call to machine::run_posted() returns, so a
+   * machine is never run by more than one of an %executor's threads at once.
+   *
+   * @param m The machine that has posted events pending.
+   * @note Implementations must not call machine::run_posted() from within
+   * this function itself since it may be called from within one of the
+   * machine's own actions.
+   */
+  virtual void execute( machine &m ) = 0;
+};
+
+/**
+ * A %thread_executor \e is-an executor that runs machines on a single thread
+ * that it owns.  Any number of machines may be bound to it.
+ *
+ * @author Paul J. Lucas
+ */
+class thread_executor : public executor {
+public:
+  /**
+   * Constructs a %thread_executor and starts its thread.
+   */
+  thread_executor();
+
+  /**
+   * Destroys a %thread_executor, but only after its thread has run all
+   * machines that requested it.
+   */
+  ~thread_executor();
+
+  void execute( machine &m ) override;
 
-  protected:
-    pointer const  *p_;
-    child_list      c_;
+private:
+  thread_executor( thread_executor const& ) = delete;
+  thread_executor& operator=( thread_executor const& ) = delete;
 
-    const_iterator( pointer const *p, child_list c ) : p_{ p }, c_{ c } { }
+  /**
+   * The main loop of the thread.
+   */
+  void main_loop();
 
-    friend class parent;
-  };
+  std::mutex              mutex_;       ///< Guards the data below.
+  std::condition_variable cv_;          ///< Signalled upon execute().
+  std::deque<machine*>    run_queue_;   ///< Machines to run.
+  bool                    stopping_;    ///< Is the destructor waiting?
+  std::thread             thread_;      ///< The thread.
+};
 
+/**
+ * A %scheduler \e is-an executor that runs any number of machines on a pool
+ * of worker threads, typically one per core.  Each worker has its own run
+ * queue of machines having posted events pending; a worker whose run queue is
+ * empty steals machines from the other workers' run queues.
+ *
+ * A machine is never run by more than one worker at once.
+ *
+ * @author Paul J. Lucas
+ */
+class scheduler : public executor {
+public:
   /**
-   * Returns a parent::const_iterator positioned at the first child state of a
-   * parent.
+   * Constructs a %scheduler and starts its worker threads.
    *
-   * @return Returns said iterator.
+   * @param workers The number of worker threads.  If zero, the number of
+   * hardware threads is used.
    */
-  const_iterator begin() const {
-    return const_iterator{ machine_.state_, children_ };
-  }
+  explicit scheduler( unsigned workers = 0 );
 
   /**
-   * Returns a parent::const_iterator positioned at one past the last child
-   * state of a parent.
-   *
-   * @return Returns said iterator.
+   * Destroys a %scheduler, but only after its workers have run all machines
+   * that requested it.
    */
-  const_iterator end() const {
-    return const_iterator{ nullptr, &NO_CHILD_ID_ };
-  }
+  ~scheduler();
 
-  // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+  /**
+   * Requests that the given machine be run.  If called from one of this
+   * %scheduler's own worker threads (e.g., by an event posted from within an
+   * action), the machine is put on that worker's run queue; otherwise it's
+   * distributed round-robin.
+   *
+   * @param m The machine that has posted events pending.
+   */
+  void execute( machine &m ) override;
 
-protected:
   /**
-   * @internal
+   * Gets the number of worker threads.
    *
-   * Constructs a parent.
+   * @return Returns said number.
    */
-  parent( CHSM_PARENT_ARGS ) :
-    state{ CHSM_STATE_INIT },
-    children_{ chsm_children_ }
-  {
+  unsigned workers() const {
+    return n_workers_;
   }
 
+private:
+  scheduler( scheduler const& ) = delete;
+  scheduler& operator=( scheduler const& ) = delete;
+
+  struct worker;
+
   /**
-   * @internal
+   * The main loop of a worker thread.
    *
-   * Requests that an inactive child state become the active child of its
-   * parent state.
+   * @param i The index of the worker.
+   */
+  void main_loop( unsigned i );
+
+  /**
+   * Gets the next machine to run for a worker: the most recently queued
+   * machine from its own run queue, if any; otherwise, the least recently
+   * queued machine from some other worker's run queue.
    *
-   * @param child The child state requesting permission to become the active
-   * child.
-   * @return Returns `true` by default.
+   * @param i The index of the worker.
+   * @return Returns said machine or null if all run queues are empty.
    */
-  virtual bool switch_active_child_to( state *child );
+  machine* next_machine( unsigned i );
 
-  // for access to switch_active_child_to()
-  friend bool state::enter( event const&, state* );
+  worker       *worker_;                ///< The workers.
+  unsigned      n_workers_;             ///< The number of workers.
+  std::atomic<unsigned> next_worker_;   ///< For round-robin distribution.
 
-private:
-  parent( parent const& ) = delete;
-  parent& operator=( parent const& ) = delete;
+  /**
+   * The total number of machines in all run queues.
+   */
+  std::atomic<std::size_t> pending_;
 
-  child_list const  children_;          ///< The child states.
-  static id const   NO_CHILD_ID_;       ///< Sentinel for end().
+  std::atomic<unsigned>   sleepers_;    ///< Number of idle workers.
+  std::mutex              idle_mutex_;  ///< Used only for idle_cv_.
+  std::condition_variable idle_cv_;     ///< Signalled when work arrives.
+  bool                    stopping_;    ///< Is the destructor waiting?
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
 /**
- * A %cluster \e is-a CHSM::parent that can have at most one child-state active
- * at any given time.
- *
- * A %cluster may have a history.  If a %cluster does not have a history, or it
- * does have a history but has not previously been active, then the child-state
- * entered after it itself is entered is the \e default child-state; if a
- * %cluster does have a history and it has been visited before, then the child-
- * state entered after it itself is entered is the one that was last active.
- *
- * A %cluster may alternatively have a \e deep history.  Such a %cluster
- * behaves exactly as one with an ordinary history; the difference is that all
- * clusters lexically-enclosed by it in the CHSM description also have a
- * history.
- *
- * The %cluster class can be extended either to add additional data members and
- * member functions, or to alter its behavior upon being entered or exited.
+ * A %clock is the source of time for timeouts, event latencies, and trace
+ * records.  By default, time is real time (`std::chrono::steady_clock`), but
+ * some other %clock, e.g., a simulator, may be installed in its place.
  *
  * @author Paul J. Lucas
  */
-class cluster : public parent {
+class clock {
 public:
-# define  CHSM_CLUSTER_ARG_LIST(A) \
-          CHSM_PARENT_ARG_LIST(A), \
-          A(bool) chsm_history_
+  /**
+   * Destroys a %clock.
+   */
+  virtual ~clock();
 
   /**
-   * Defines the constructor arguments for the CHSM::cluster class.
+   * Gets the current time of this %clock.
    *
-   * @hideinitializer
+   * @return Returns said time since some arbitrary epoch.
    */
-# define  CHSM_CLUSTER_ARGS       CHSM_CLUSTER_ARG_LIST(CHSM_FORMAL)
+  virtual std::chrono::nanoseconds now() const = 0;
 
   /**
-   * Defines the base-class constructor argument \e mem-initializers for the
-   * CHSM::cluster class.
+   * Gets the current time of the installed %clock, if any; otherwise real
+   * time.
    *
-   * @hideinitializer
+   * @return Returns said time since some arbitrary epoch.
    */
-# define  CHSM_CLUSTER_INIT       CHSM_CLUSTER_ARG_LIST(CHSM_ACTUAL)
+  static std::chrono::nanoseconds read() {
+    clock const *const c = installed_.load( std::memory_order_acquire );
+    return c != nullptr ?
+      c->now() : std::chrono::steady_clock::now().time_since_epoch();
+  }
 
   /**
-   * Constructs a cluster.
+   * Installs a %clock in place of real time.
    *
-   * When deriving a class from %cluster, the macros `CHSM_CLUSTER_ARGS` and
-   * `CHSM_CLUSTER_INIT` can be used to avoid having to deal with the many
-   * constructor arguments.  See CHSM::state for an example.
+   * @param c The %clock to install or null for real time.
+   * @return Returns the previously installed %clock, if any.
+   * @note This must be called only while no timeout is armed.
    */
-  cluster( CHSM_CLUSTER_ARGS );
+  static clock* install( clock *c );
 
   /**
-   * Clears the history.
+   * Gets the installed %clock, if any.
+   *
+   * @return Returns said %clock or null for real time.
    */
-  void clear() {
-    last_child_ = &front();
+  static clock* installed() {
+    return installed_.load( std::memory_order_acquire );
   }
 
+private:
+  static std::atomic<clock*> installed_;
+};
+
+/**
+ * A %simulator \e is-a clock and \e is-an executor that runs machines in
+ * virtual time on the calling thread.  Virtual time starts at zero and stands
+ * still while machines run; when no machine has posted events pending, it
+ * jumps straight to the next expiry of an armed timeout.  Hence machines run
+ * back to back with no sleeping, hours of timeouts take only as long as their
+ * transitions do, and, given the same sequence of posts, each run is the same
+ * as every other down to its trace records.
+ *
+ * Only one %simulator may exist at a time.  While it does, it's the installed
+ * clock, so the timer wheel's thread no longer expires timeouts: run() does.
+ * Machines may be bound to it via machine::set_executor() so that events they
+ * post to each other are run in order of posting; unbound machines also work
+ * since events posted to them from the calling thread are broadcast
+ * immediately.  Either way, all events must be posted from the thread calling
+ * run().
+ *
+ * @author Paul J. Lucas
+ */
+class simulator : public clock, public executor {
+public:
   /**
-   * Clears the history, if any; then clear all child cluster's history, if
-   * any.
+   * Constructs a %simulator and installs it as the clock.
+   *
+   * @note No timeout may be armed at this time.
    */
-  void deep_clear() override;
+  simulator();
 
   /**
-   * Enters a %cluster via a transition and also enter one of its child states.
+   * Destroys a %simulator and reinstalls the clock that was installed before
+   * it was constructed.
    *
-   * @param trigger The event that triggered the transition.
-   * @param from_child If not null, this child state of the cluster is being
-   * entered directly.
-   * @return Returns `true` only if the %cluster was actually entered, i.e., it
-   * wasn't already active.
+   * @note No timeout may be armed at this time.
    */
-  bool enter( event const &trigger, state *from_child = nullptr ) override;
+  ~simulator();
+
+  void execute( machine &m ) override;
+  std::chrono::nanoseconds now() const override;
 
   /**
-   * Exits a %cluster via a transition, but first exit its active child state.
+   * Runs machines until there is nothing left to do: no machine has posted
+   * events pending and no timeout is armed.
    *
-   * @param trigger The event that triggered the transition.
-   * @param to The state that is being transitioned to.
-   * @return Returns `true` only if the %cluster actually exited, i.e., it was
-   * active.
+   * @return Returns the number of timeouts expired.
    */
-  bool exit( event const &trigger, state *to = nullptr ) override;
+  std::size_t run() {
+    return run_until( std::chrono::nanoseconds::max() );
+  }
 
-  // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+  /**
+   * Runs machines for a given amount of virtual time.
+   *
+   * @param d The amount of time.
+   * @return Returns the number of timeouts expired.
+   */
+  std::size_t run_for( std::chrono::nanoseconds d ) {
+    return run_until( now_ + d );
+  }
+
+  /**
+   * Runs machines until a given virtual time.  Virtual time is then that
+   * time (unless it's `nanoseconds::max()`) even if there was nothing to do.
+   *
+   * @param t The time.
+   * @return Returns the number of timeouts expired.
+   */
+  std::size_t run_until( std::chrono::nanoseconds t );
 
 private:
-  cluster( cluster const& ) = delete;
-  cluster& operator=( cluster const& ) = delete;
+  simulator( simulator const& ) = delete;
+  simulator& operator=( simulator const& ) = delete;
 
-  bool switch_active_child_to( state *child ) override;
+  /**
+   * Runs all machines that have posted events pending, including those that
+   * become pending while doing so.
+   */
+  void run_machines();
 
-  bool const  history_;                 ///< Does this cluster have a history?
-  state      *active_child_;            ///< Currently active child, if any.
-  state      *last_child_;              ///< Last active child, if any.
+  std::chrono::nanoseconds  now_;       ///< Current virtual time.
+  std::deque<machine*>      run_queue_; ///< Machines to run.
+  clock                    *prev_;      ///< Previously installed clock.
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
 /**
- * A %set \e is-a CHSM::parent that has either all or no child-states active.
- * All child-states are entered after and exited before their parent-state.
- * The order that child-states are entered and exited is undefined.
+ * A %fleet_base is the part of a fleet that doesn't depend on the class of its
+ * machines.
  *
- * The %set class can be extended either to add additional data members and
- * member functions, or to alter its behavior upon being entered or exited.
+ * The configuration bitsets of all its machines are stored together in
+ * struct-of-arrays form (all the words of the first machine, then all the
+ * words of the second, and so on) so that finding the machines an %event can
+ * possibly take a transition in is a single pass over contiguous memory.
  *
  * @author Paul J. Lucas
  */
-class set : public parent {
+class fleet_base {
 public:
-# define  CHSM_SET_ARG_LIST(A) \
-          CHSM_PARENT_ARG_LIST(A)
+  /**
+   * Gets the number of machines in this %fleet_base.
+   *
+   * @return Returns said number.
+   */
+  std::size_t size() const {
+    return machines_.size();
+  }
 
+protected:
   /**
-   * Defines the constructor arguments for the CHSM::set class.
+   * Constructs a %fleet_base.
    *
-   * @hideinitializer
+   * @param machines The machines of the fleet.  They must all be of the same
+   * class.
    */
-# define  CHSM_SET_ARGS   CHSM_SET_ARG_LIST(CHSM_FORMAL)
+  explicit fleet_base( std::vector<machine*> &&machines );
 
   /**
-   * Defines the base-class constructor argument \e mem-initializers for the
-   * CHSM::set class.
+   * Destroys a %fleet_base.  The machines must have been destroyed first.
+   */
+  ~fleet_base();
+
+  /**
+   * Selects the machines in which an %event can possibly take a transition:
+   * those in which any of the "from" states of the %event's transitions, or
+   * of those of its base events, are active.
    *
-   * @hideinitializer
+   * @param e The %event of (any) one of the machines.
+   * @return Returns the indices of the selected machines in ascending order.
    */
-# define  CHSM_SET_INIT   CHSM_SET_ARG_LIST(CHSM_ACTUAL)
+  std::vector<std::size_t> const& select( event const &e );
+
+  std::vector<machine*> const machines_;  ///< The machines.
+
+private:
+  fleet_base( fleet_base const& ) = delete;
+  fleet_base& operator=( fleet_base const& ) = delete;
+
+  unsigned const            words_;     ///< Words per configuration.
+  std::vector<config_word>  configs_;   ///< Configurations of all machines.
+  std::vector<std::size_t>  selected_;  ///< Machines selected by select().
+};
 
+/**
+ * A %fleet is a fixed number of instances of the same machine class that an
+ * %event can be broadcast to all of at once.  Only those instances in which
+ * the %event can possibly take a transition are actually broadcast to: the
+ * others are skipped without being locked, so neither the %event's
+ * precondition (if any) nor any other per-instance code is run for them.
+ *
+ * @tparam MachineClass The machine class emitted by the CHSM-to-C++ compiler.
+ * @note While an %event is being broadcast to a %fleet, none of its machines
+ * may be running on any other thread.
+ */
+template<class MachineClass>
+class fleet : public fleet_base {
+public:
   /**
-   * Constructs a %set.
+   * Constructs a %fleet.
    *
-   * When deriving a class from %set, the macros `CHSM_SET_ARGS` and
-   * `CHSM_SET_INIT` can be used to avoid having to deal with the many
-   * constructor arguments.  See CHSM::state for an example.
+   * @tparam Args The types of the machine constructor's arguments, if any.
+   * @param n The number of machines.
+   * @param args The arguments to construct each machine with, if any.
    */
-  set( CHSM_SET_ARGS ) : parent{ CHSM_PARENT_INIT } { }
+  template<typename... Args>
+  explicit fleet( std::size_t n, Args const&... args ) :
+    fleet{ create( n, args... ) }
+  {
+  }
 
   /**
-   * Enters a %set via a transition and also enters all of its child states.
+   * Destroys a %fleet and all of its machines.
+   */
+  ~fleet() {
+    for ( machine *const m : machines_ )
+      delete static_cast<MachineClass*>( m );
+  }
+
+  /**
+   * Gets one of the machines of this %fleet.
    *
-   * @param trigger The event that triggered the transition.
-   * @param from_child Not used here.
-   * @return Returns `true` only if the %set was actually entered, i.e., it
-   * wasn't already active.
+   * @param i The index of the machine.
+   * @return Returns said machine.
    */
-  bool enter( event const &trigger, state *from_child = nullptr ) override;
+  MachineClass& operator[]( std::size_t i ) {
+    return *static_cast<MachineClass*>( machines_[i] );
+  }
 
   /**
-   * Exits a %set via a transition, but first exits all of its child states.
+   * Broadcasts an %event to all the machines of this %fleet in which it can
+   * possibly take a transition, e.g.:
+   * @code
+   *  fleet<session> sessions{ 100000 };
+   *  // ...
+   *  sessions.broadcast( &session::tick );
+   * @endcode
    *
-   * @param trigger The event that triggered the transition.
-   * @param to The state we are transitioning to.
-   * @return Returns `true` only if the %set actually exited, i.e., it was
-   * active.
+   * @tparam EventClass The class of the %event.
+   * @tparam Args The types of the %event's parameters.
+   * @param e The %event as a pointer to a data member of \a MachineClass.
+   * @param args The %event's parameters, if any.
+   * @return Returns the number of machines the %event was broadcast to.
    */
-  bool exit( event const &trigger, state *to = nullptr ) override;
+  template<class EventClass,typename... Args>
+  std::size_t broadcast( EventClass MachineClass::*e, Args const&... args ) {
+    if ( machines_.empty() )
+      return 0;
+    std::vector<std::size_t> const &selected = select( (*this)[0].*e );
+    for ( std::size_t const i : selected )
+      ((*this)[i].*e)( args... );
+    return selected.size();
+  }
 
-  set( set const& ) = delete;
-  set& operator=( set const& ) = delete;
+private:
+  typedef std::vector<std::unique_ptr<MachineClass>> owned_type;
+
+  /**
+   * Constructs a %fleet from machines that are deleted if an exception is
+   * thrown before fleet_base takes ownership of them.
+   *
+   * @param owned The machines.
+   */
+  explicit fleet( owned_type &&owned ) :
+    fleet_base{ machines_of( owned ) }
+  {
+    for ( auto &m : owned )
+      m.release();
+  }
+
+  template<typename... Args>
+  static owned_type create( std::size_t n, Args const&... args ) {
+    owned_type owned;
+    owned.reserve( n );
+    while ( n-- > 0 )
+      owned.emplace_back( new MachineClass( args... ) );
+    return owned;
+  }
+
+  static std::vector<machine*> machines_of( owned_type const &owned ) {
+    std::vector<machine*> machines;
+    machines.reserve( owned.size() );
+    for ( auto const &m : owned )
+      machines.push_back( m.get() );
+    return machines;
+  }
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
+/**
+ * @internal
+ *
+ * Every lock of a machine's mutex other than the transition algorithm's own
+ * must be a %machine_lock: a thread that posts an event while the mutex is
+ * held leaves it for the holder to broadcast (see machine::drain_inbox()).
+ */
 struct event::machine_lock : lock_type {
-  explicit machine_lock( machine &m ) : lock_type{ m.mutex_ } { }
+  explicit machine_lock( machine const &m ) :
+    lock_type{ m.mutex_ }, machine_{ m }
+  {
+  }
+
+  /**
+   * Releases the lock and then broadcasts any events that were posted to the
+   * machine while it was held.
+   */
+  ~machine_lock() {
+    unlock();
+    machine_.drain_inbox();
+  }
+
+private:
+  machine const &machine_;
 };
 
 ////////// inlines ////////////////////////////////////////////////////////////
@@ -1710,7 +4043,11 @@ inline event::const_iterator event::begin() const {
   // This has to be defined down here so that the declaration for the machine
   // class has been seen by the C++ compiler.
   //
-  return const_iterator{ machine_.transition_, transitions_, base_event_ };
+  return const_iterator{ machine_.transition_, desc_.transitions_ };
+}
+
+inline bool state::published_active() const {
+  return machine_.published_active( desc_.id_ );
 }
 
 inline bool machine::active() const {
@@ -1720,12 +4057,88 @@ inline bool machine::active() const {
   return root_.active();
 }
 
+inline parent* state::parent_of() const {
+  //
+  // This has to be defined down here so that the declarations for the
+  // machine and parent classes have been seen by the C++ compiler.
+  //
+  if ( desc_.id_ == machine::NO_STATE_ID_ )
+    return nullptr;                     // the root has no parent
+  if ( desc_.parent_id_ == machine::NO_STATE_ID_ )
+    return &machine_.root_;
+  return static_cast<parent*>( machine_.state_[ desc_.parent_id_ ] );
+}
+
 inline bool transition::is_internal() const {
   return to_id_ == machine::NO_STATE_ID_ && target_ == nullptr;
 }
 
+template<class EventClass,typename... Args>
+machine::ticket machine::post( EventClass &e, Args&&... args ) {
+  typedef typename EventClass::param_block param_block;
+  static_assert(
+    alignof( param_block ) <= alignof( std::max_align_t ),
+    "param_block is over-aligned"
+  );
+
+  inbox_entry *const entry = inbox_claim();
+  void *storage = entry->storage_;
+  if ( sizeof( param_block ) > sizeof entry->storage_ )
+    storage = entry->heap_ = ::operator new( sizeof( param_block ) );
+
+  try {
+    entry->param_block_ =
+      new( storage ) param_block( e, std::forward<Args>( args )... );
+    entry->event_ = &e;
+  }
+  catch ( ... ) {
+    //
+    // The entry has already been claimed so it must be published anyway;
+    // since its event_ is null, it will merely be skipped.
+    //
+    inbox_publish( entry );
+    throw;
+  }
+  return inbox_publish( entry );
+}
+
+template<class EventClass,typename... Args>
+machine::batch& machine::batch::add( EventClass &e, Args&&... args ) {
+  typedef typename EventClass::param_block param_block;
+  static_assert(
+    alignof( param_block ) <= alignof( std::max_align_t ),
+    "param_block is over-aligned"
+  );
+
+  param_block *const pb = new( allocate( sizeof( param_block ) ) )
+    param_block( e, std::forward<Args>( args )... );
+  try {
+    entries_.push_back( entry{ &e, pb } );
+  }
+  catch ( ... ) {
+    static_cast<event::param_block*>( pb )->~param_block();
+    throw;
+  }
+  return *this;
+}
+
 } // namespace
 
+namespace std {
+
+/**
+ * Specialization of `std::hash` for CHSM::machine::configuration so it can be
+ * used as a key in unordered containers.
+ */
+template<>
+struct hash<CHSM_NS::machine::configuration> {
+  size_t operator()( CHSM_NS::machine::configuration const &c ) const {
+    return c.hash();
+  }
+};
+
+} // namespace std
+
 ////////// namespace stuff ////////////////////////////////////////////////////
 
 /**
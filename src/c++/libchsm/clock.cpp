@@ -0,0 +1,56 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/clock.cpp -- Run-Time library implementation
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#define CHSM_NO_ALIAS_NS
+#include "chsm.h"
+#include "timer_wheel.h"
+
+// standard
+#include <atomic>
+
+using namespace std;
+
+namespace CHSM_NS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+atomic<clock*> clock::installed_;
+
+clock::~clock() {
+  // out-of-line since it's virtual
+}
+
+clock* clock::install( clock *c ) {
+  clock *const old = installed_.exchange( c, memory_order_acq_rel );
+  if ( c != old ) {
+    //
+    // Ticks of the timer wheel are relative to the clock, so it has to start
+    // over from the new clock's current time.
+    //
+    timer_wheel::instance().restart();
+  }
+  return old;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+/* vim:set et sw=2 ts=2: */
@@ -27,10 +27,7 @@ namespace CHSM_NS {
 
 ///////////////////////////////////////////////////////////////////////////////
 
-cluster::cluster( CHSM_CLUSTER_ARGS ) :
-  parent{ CHSM_PARENT_INIT },
-  history_{ chsm_history_ }
-{
+cluster::cluster( CHSM_CLUSTER_ARGS ) : parent{ CHSM_PARENT_INIT } {
   active_child_ = last_child_ = nullptr;
 }
 
@@ -54,7 +51,7 @@ bool cluster::enter( event const &trigger, state *from_child ) {
     active_child_ = last_child_ = from_child;
   }
   else {
-    if ( last_child_ == nullptr || !history_ ) {
+    if ( last_child_ == nullptr || !desc_.history_ ) {
       //
       // We were never active before (and thus have no last_child_) or we have
       // no history: in either case, we must enter our default child state.
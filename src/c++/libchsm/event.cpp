@@ -24,49 +24,119 @@
 #include "util.h"
 
 // standard
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
 
 using namespace std;
 
 namespace CHSM_NS {
 
 transition::id const event::NO_TRANSITION_ID_ = -1;
-
-////////// inline functions ///////////////////////////////////////////////////
-
-inline bool event::is_debug_events() const {
-  return machine_.is_debug( machine::DEBUG_EVENTS );
-}
+#ifndef CHSM_NO_METRICS
+latency_histogram const event::NO_LATENCY_;
+#endif /* CHSM_NO_METRICS */
 
 ///////////////////////////////////////////////////////////////////////////////
 
 event::event( CHSM_EVENT_ARGS ) :
   machine_{ *chsm_machine_ },
-  in_progress_{ 0 },
-  param_block_{ nullptr },
-  name_{ chsm_name_ },
+  param_slot_{ nullptr },
+  param_block_{
+    chsm_base_event_ != nullptr ? chsm_base_event_->param_block_ : param_slot_
+  },
+  own_param_block_{ nullptr },
+  extras_{ nullptr },
+  desc_{ chsm_descriptor_ },
   base_event_{ chsm_base_event_ },
-  transitions_{ chsm_transition_list_ }
+  next_event_{ nullptr },
+  in_progress_{ 0 },
+  id_{ -1 }
 {
-  // do nothing else
+  //
+  // Add ourselves to our machine's list of events (except for PRIME_EVENT_
+  // that has no machine).  Since the list is newest first, our ID is one more
+  // than that of the event before us.
+  //
+  if ( chsm_machine_ != nullptr ) {
+    next_event_ = machine_.events_;
+    machine_.events_ = this;
+    id_ = next_event_ != nullptr ? next_event_->id_ + 1 : 0;
+  }
 }
 
 event::~event() {
-  // out-of-line since it's virtual
+  extras *const x = extras_.load( memory_order_acquire );
+  if ( x == nullptr )
+    return;
+#ifndef CHSM_NO_METRICS
+  delete x->latency_.load( memory_order_acquire );
+#endif /* CHSM_NO_METRICS */
+  while ( param_block *const pb = x->parked_head_ ) {
+    x->parked_head_ = pb->chsm_next_;
+    pb->~param_block();
+  } // while
+  while ( pool_block *const chunk = x->pool_chunks_ ) {
+    x->pool_chunks_ = chunk->next_;
+    ::operator delete( chunk );
+  } // while
+  delete x;
 }
 
-void event::broadcast( void *pb ) {
-  if ( in_progress_ > 0 )               // we're already in progress
+void event::broadcast( void *pb, bool pooled ) {
+  if ( in_progress_ > 0 ) {             // we're already in progress
+    if ( pb != nullptr ) {
+      //
+      // Rather than dropping this instance of the event, park it so it's
+      // broadcast with its own parameters later.
+      //
+      park( static_cast<param_block*>( pb ), pooled );
+    }
     return;
+  }
 
   //
-  // Mark ourselves and our base event(s), if any, as being in progress.
+  // If this broadcast gets cancelled, we loop around to broadcast the next
+  // parked instance, if any, rather than recursing.
   //
-  for ( auto e = this; e != nullptr; e = e->base_event_ )
-    ++e->in_progress_;
+  for (;;) {
+    //
+    // Mark ourselves and our base event(s), if any, as being in progress.
+    //
+    for ( auto e = this; e != nullptr; e = e->base_event_ )
+      ++e->in_progress_;
+
+    if ( machine_.is_tracing() )
+      machine_.emit_trace( machine::TRACE_BROADCAST, this );
+#ifndef CHSM_NO_METRICS
+    ++broadcasts_;
+#endif /* CHSM_NO_METRICS */
+
+    own_param_block_ = pb;
+    if ( pb != nullptr )
+      static_cast<param_block*>( pb )->chsm_pooled_ = pooled;
+
+    if ( enqueue( pb ) )
+      return;
+
+    release();
+    broadcast_parked_bases();
+    param_block *const next = unpark();
+    if ( next == nullptr )
+      return;
+    pb = next;
+    pooled = next->chsm_pooled_;
+  } // for
+}
 
-  if ( is_debug_events() )
-    machine_.dout() << "broadcast: " << name() ENDL;
+bool event::enqueue( void *pb ) {
+  //
+  // Our param_block_ is shared with our base and derived events, one of which
+  // may be in the midst of a micro-step using it: put it back when done.
+  //
+  void *const prev_param_block = param_block_;
 
   bool is_precondition_true;
   if ( (param_block_ = pb) != nullptr ) {
@@ -93,9 +163,8 @@ void event::broadcast( void *pb ) {
       is_precondition_true = false;
     }
 
-    if ( is_debug_events() )
-      machine_.dout()
-        << "+ precondition: " << (is_precondition_true ? "true" : "false") ENDL;
+    if ( machine_.is_tracing() )
+      machine_.emit_trace( machine::TRACE_PRECONDITION, this, is_precondition_true );
   }
   else {
     is_precondition_true = true;
@@ -106,130 +175,204 @@ void event::broadcast( void *pb ) {
     // Queue ourselves and run algorithm.
     //
     machine_.event_queue_.push_back( this );
-    if ( is_debug_events() )
-      machine_.dout() << "queued   : " << name() ENDL;
-    machine_.algorithm();
-  }
-  else {
+#ifndef CHSM_NO_METRICS
     //
-    // This event is not to be queued: destroy its parameter block and return.
+    // If the algorithm is in progress, we're being broadcast during a
+    // micro-step, so use the clock reading from the end of the last one.
     //
-    if ( is_debug_events() )
-      machine_.dout() << "broadcast: " << name() << " -- cancelled" ENDL;
-    broadcasted();
+    if ( machine_.record_latency_ ) {
+      if ( !machine_.in_progress_ )
+        machine_.clock_ns_ = machine::read_clock_ns();
+      extras_of().queued_ns_ = machine_.clock_ns_;
+    }
+#endif /* CHSM_NO_METRICS */
+    if ( machine_.is_tracing() )
+      machine_.emit_trace( machine::TRACE_QUEUED, this );
+    machine_.algorithm();
+    param_block_ = prev_param_block;
+    return true;
   }
-}
 
-void event::broadcasted() {
   //
-  // This check isn't strictly necessary...but I feel better having it here.
+  // This event is not to be queued: the caller destroys its parameter block.
   //
-  if ( in_progress_ > 0 ) {
-    //
-    // Unmark ourselves and our base events, if any, as being in progress.
-    //
-    for ( auto e = this; e != nullptr; e = e->base_event_ )
-      if ( e->in_progress_ > 0 )
-        --e->in_progress_;
+#ifndef CHSM_NO_METRICS
+  if ( is_precondition_true )
+    ++cancelled_;
+  else
+    ++rejected_;
+#endif /* CHSM_NO_METRICS */
+  if ( machine_.is_tracing() )
+    machine_.emit_trace( machine::TRACE_CANCELLED, this );
+  param_block_ = prev_param_block;
+  return false;
+}
 
-    if ( param_block_ != nullptr ) {
-      //
-      // Since a param_block object is never created nor destroyed (in terms of
-      // allocation and deallocation), we have to call its destructor
-      // explicitly to destroy (but not deallocate) it.
-      //
-      static_cast<param_block*>( param_block_ )->param_block::~param_block();
-    }
-  }
+void event::broadcasted() {
+  release();
+  if ( param_block *const pb = unpark() )
+    broadcast( pb, pb->chsm_pooled_ );
+  broadcast_parked_bases();
+}
+
+void event::broadcast_parked_bases() {
+  for ( auto e = base_event_; e != nullptr; e = e->base_event_ )
+    if ( param_block *const pb = e->unpark() )
+      e->broadcast( pb, pb->chsm_pooled_ );
 }
 
 bool event::find_transition() {
-  if ( is_debug_events() )
-    machine_.dout() << "+ checking transitions" ENDL;
+  if ( machine_.is_tracing() )
+    machine_.emit_trace( machine::TRACE_CHECKING, this );
 
-  bool found = false;
+  //
+  // If none of the event's "from" states are active, there's nothing to do.
+  //
+  if ( !machine_.is_any_active( desc_.sources_ ) )
+    return false;
 
   //
-  // Iterate through our event's transitions finding those that will be taken,
-  // if any.
+  // Rather than iterating through all of our event's transitions (which
+  // include those of our base events, if any), use the dispatch table to
+  // collect the entries of only those whose "from" states are active.
   //
-  for ( auto t = begin(); t != end(); ++t ) {
-    try {
-      state &from = *machine_.state_[ t->from_id_ ];
-      //
-      // We must check specifically for "plain active" so we don't make more
-      // than one nondeterministic transition from the same state.  This is the
-      // only place in the code that makes a distinction between "plain active"
-      // and "active disabled."
-      //
-      if ( from.state_ != state::STATE_ACTIVE )
-        continue;
+  // The entries are collected into a buffer local to this call because a
+  // condition or target function may broadcast an event and so call this
+  // function recursively.  Most events have few enough entries that it's on
+  // the stack; if not, it's moved to the heap.
+  //
+  dispatch const *local[ 16 ];
+  unique_ptr<dispatch const*[]> heap;
+  dispatch const **dispatched = local;
+  size_t n_dispatched = 0;
 
-      //
-      // If the transition has a condition, evaluate it to see whether we
-      // should continue.
-      //
-      if ( t->condition_ != nullptr && !(machine_.*(t->condition_))( *this ) )
+  auto d = desc_.dispatch_;
+  while ( d->from_id_ != machine::NO_STATE_ID_ ) {
+    //
+    // We're at the first entry of a region: if its parent isn't active,
+    // none of its child states are either, so skip the entire region.
+    //
+    auto const region_end = d + d->region_left_;
+    if ( !machine_.state_[ d->from_id_ ]->parent_of()->active() ) {
+      d = region_end;
+      continue;
+    }
+
+    for ( ; d != region_end; ++d ) {
+      if ( !machine_.state_[ d->from_id_ ]->active() )
         continue;
+      if ( n_dispatched == sizeof local / sizeof local[0] && !heap ) {
+        size_t n_entries = n_dispatched;
+        for ( auto e = d; e->from_id_ != machine::NO_STATE_ID_; ++e )
+          ++n_entries;
+        heap.reset( new dispatch const*[ n_entries ] );
+        copy( local, local + n_dispatched, heap.get() );
+        dispatched = heap.get();
+      }
+      dispatched[ n_dispatched++ ] = d;
+      if ( d->exclusive_ ) {
+        //
+        // The parent is a cluster, so none of our active state's siblings
+        // can be active.
+        //
+        d = region_end;
+        break;
+      }
+    } // for
+  } // while
 
-      //
-      // Mark this transition as taken using the event that triggered it.
-      //
-      if ( machine_.taken_[ t.id() ] == nullptr )
-        machine_.taken_[ t.id() ] = this;
+  //
+  // The entries are grouped by region, but conditions and target functions
+  // may have side effects, so find the transitions in the order in which
+  // they were declared just as if we had iterated through all of them.
+  //
+  sort(
+    dispatched, dispatched + n_dispatched,
+    []( dispatch const *a, dispatch const *b ) { return a->first_ < b->first_; }
+  );
 
-      if ( !t->is_internal() ) {
-        if ( t->target_ != nullptr ) {
-          //
-          // The transition has a target function: execute it to compute the
-          // target state.
-          //
-          if ( auto to = (machine_.*(t->target_))( *this ) ) {
-            assert( transition::is_legal( &from, to ) );
-            machine_.target_[ t.id() ] = to;
-          }
-          else {
-            //
-            // The target function returned null: skip this transition.
-            //
-            continue;
-          }
+  bool found = false;
+  for ( size_t j = 0; j < n_dispatched; ++j )
+    for ( auto i = dispatched[j]->first_; i < dispatched[j]->last_; ++i )
+      if ( find_transition( desc_.transitions_[i] ) )
+        found = true;
+
+  return found;
+}
+
+bool event::find_transition( transition::id tid ) {
+  transition const &t = machine_.transition_[ tid ];
+  try {
+    state &from = *machine_.state_[ t.from_id_ ];
+    //
+    // We must check specifically for "plain active" so we don't make more
+    // than one nondeterministic transition from the same state.  This is the
+    // only place in the code that makes a distinction between "plain active"
+    // and "active disabled."
+    //
+    if ( from.state_ != state::STATE_ACTIVE )
+      return false;
+
+    //
+    // If the transition has a condition, evaluate it to see whether we should
+    // continue.
+    //
+    if ( t.condition_ != nullptr && !(machine_.*(t.condition_))( *this ) )
+      return false;
+
+    //
+    // Mark this transition as taken using the event that triggered it.
+    //
+    if ( machine_.taken_[ tid ] == nullptr )
+      machine_.taken_[ tid ] = this;
+
+    if ( !t.is_internal() ) {
+      if ( t.target_ != nullptr ) {
+        //
+        // The transition has a target function: execute it to compute the
+        // target state.
+        //
+        if ( auto to = (machine_.*(t.target_))( *this ) ) {
+          assert( transition::is_legal( &from, to ) );
+          machine_.target_[ tid ] = to;
         }
         else {
           //
-          // The transition goes to a hard-coded target state.
+          // The target function returned null: skip this transition.
           //
-          machine_.target_[ t.id() ] = machine_.state_[ t->to_id_ ];
+          return false;
         }
-
+      }
+      else {
         //
-        // Leave the "from" state active, but mark as disabled to prevent
-        // making more than one nondeterministic transition from the same
-        // state.
+        // The transition goes to a hard-coded target state.
         //
-        from.state_ = state::STATE_ACTIVE_DISABLED;
+        machine_.target_[ tid ] = machine_.state_[ t.to_id_ ];
       }
 
-      found = true;
-
-      if ( is_debug_events() ) {
-        machine_.dout() << "+ found  : " << from.name();
-        if ( !t->is_internal() )
-          MORE << " -> " << machine_.target_[ t.id() ]->name();
-        else
-          MORE << " (internal)";
-        MORE ENDL;
-      }
-    }
-    catch ( ... ) {
       //
-      // Ignore any exception that either a condition or a target function may
-      // have thrown.
+      // Leave the "from" state active, but mark as disabled to prevent making
+      // more than one nondeterministic transition from the same state.
       //
+      from.state_ = state::STATE_ACTIVE_DISABLED;
     }
-  } // for
 
-  return found;
+    if ( machine_.is_tracing() ) {
+      machine_.emit_trace(
+        machine::TRACE_FOUND, this, tid,
+        t.is_internal() ?
+          machine::NO_STATE_ID_ : machine_.target_[ tid ]->desc_.id_
+      );
+    }
+    return true;
+  }
+  catch ( ... ) {
+    //
+    // Ignore any exception that either a condition or a target function may
+    // have thrown.
+    //
+    return false;
+  }
 }
 
 void event::lock_broadcast() {
@@ -237,19 +380,138 @@ void event::lock_broadcast() {
   broadcast( nullptr );
 }
 
-///////////////////////////////////////////////////////////////////////////////
+void event::park( param_block *pb, bool pooled ) {
+  if ( machine_.is_tracing() )
+    machine_.emit_trace( machine::TRACE_PARKED, this );
+  pb->chsm_pooled_ = pooled;
+  extras &x = extras_of();
+  if ( x.parked_tail_ != nullptr )
+    x.parked_tail_->chsm_next_ = pb;
+  else
+    x.parked_head_ = pb;
+  x.parked_tail_ = pb;
+}
+
+void* event::pool_allocate( size_t size ) {
+  extras &x = extras_of();
+  if ( unlikely( x.pool_free_ == nullptr ) ) {
+    if ( x.pool_block_size_ == 0 ) {
+      //
+      // Round the block size up so that every block in a chunk is aligned.
+      //
+      size_t const align = alignof( max_align_t );
+      x.pool_block_size_ =
+        (max( size, sizeof( pool_block ) ) + align - 1) / align * align;
+    }
+    assert( size <= x.pool_block_size_ );
 
-void event::const_iterator::bump() {
-  while ( *t_id_ == NO_TRANSITION_ID_ && base_event_ != nullptr ) {
     //
-    // We've exhausted our transitions; proceed to those of our base event's,
-    // if any.
+    // Grow the pool by a chunk whose first block is used only to link it to
+    // the other chunks so they can be deallocated.
     //
-    t_id_ = base_event_->transitions_;
-    base_event_ = base_event_->base_event_;
-  } // while
+    auto const chunk = static_cast<char*>(
+      ::operator new( x.pool_block_size_ * (CHSM_PARAM_POOL_CHUNK_SIZE + 1) )
+    );
+    reinterpret_cast<pool_block*>( chunk )->next_ = x.pool_chunks_;
+    x.pool_chunks_ = reinterpret_cast<pool_block*>( chunk );
+
+    for ( size_t i = CHSM_PARAM_POOL_CHUNK_SIZE; i > 0; --i ) {
+      auto const block = reinterpret_cast<pool_block*>(
+        chunk + i * x.pool_block_size_
+      );
+      block->next_ = x.pool_free_;
+      x.pool_free_ = block;
+    } // for
+  }
+
+  pool_block *const block = x.pool_free_;
+  x.pool_free_ = block->next_;
+  return block;
+}
+
+event::extras& event::extras_of() {
+  //
+  // Only the thread holding our machine's mutex allocates our extras, so
+  // there's no race to allocate it.
+  //
+  extras *x = extras_.load( memory_order_relaxed );
+  if ( x == nullptr ) {
+    x = new extras;
+    extras_.store( x, memory_order_release );
+  }
+  return *x;
+}
+
+bool event::post_again( bool ) {
+  // out-of-line since it's virtual
+  return false;
+}
+
+#ifndef CHSM_NO_METRICS
+void event::record_latency( uint64_t ns ) {
+  //
+  // Only the thread holding our machine's mutex records latencies, so there's
+  // no race to allocate the histogram.
+  //
+  extras &x = extras_of();
+  latency_histogram *h = x.latency_.load( memory_order_relaxed );
+  if ( h == nullptr ) {
+    h = new latency_histogram;
+    x.latency_.store( h, memory_order_release );
+  }
+  h->record( ns );
+}
+#endif /* CHSM_NO_METRICS */
+
+void event::release() {
+  //
+  // This check isn't strictly necessary...but I feel better having it here.
+  //
+  if ( in_progress_ == 0 )
+    return;
+
+  //
+  // Unmark ourselves and our base events, if any, as being in progress.
+  //
+  for ( auto e = this; e != nullptr; e = e->base_event_ )
+    if ( e->in_progress_ > 0 )
+      --e->in_progress_;
+
+  if ( own_param_block_ != nullptr ) {
+    //
+    // Since a param_block object is never created nor destroyed (in terms of
+    // allocation and deallocation) via new and delete, we have to call its
+    // destructor explicitly to destroy it and then deallocate it ourselves
+    // if it came from our pool (which then must exist).
+    //
+    auto const pb = static_cast<param_block*>( own_param_block_ );
+    bool const pooled = pb->chsm_pooled_;
+    pb->~param_block();
+    if ( pooled ) {
+      extras &x = *extras_.load( memory_order_relaxed );
+      auto const block = static_cast<pool_block*>( own_param_block_ );
+      block->next_ = x.pool_free_;
+      x.pool_free_ = block;
+    }
+    own_param_block_ = nullptr;
+  }
 }
 
+event::param_block* event::unpark() {
+  extras *const x = extras_.load( memory_order_relaxed );
+  if ( x == nullptr )
+    return nullptr;
+  param_block *const pb = x->parked_head_;
+  if ( pb == nullptr || in_progress_ > 0 )
+    return nullptr;
+  if ( (x->parked_head_ = pb->chsm_next_) == nullptr )
+    x->parked_tail_ = nullptr;
+  pb->chsm_next_ = nullptr;
+  return pb;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 event::param_block::~param_block() {
   // out-of-line since it's virtual
 }
@@ -0,0 +1,151 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/executor.cpp -- Run-Time library implementation
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#define CHSM_NO_ALIAS_NS
+#include "chsm.h"
+#include "inbox.h"
+
+// standard
+#include <thread>
+
+using namespace std;
+
+namespace CHSM_NS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+executor::~executor() {
+  // out-of-line since it's virtual
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+thread_executor::thread_executor() :
+  stopping_{ false },
+  thread_{ &thread_executor::main_loop, this }
+{
+}
+
+thread_executor::~thread_executor() {
+  {
+    lock_guard<mutex> const lock{ mutex_ };
+    stopping_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+void thread_executor::execute( machine &m ) {
+  //
+  // Notify while still holding our mutex: otherwise, once m has been run by
+  // our thread, some thread other than the posting one (e.g., the timer
+  // wheel's) could destroy us via machine::stop_thread() before we notify.
+  //
+  lock_guard<mutex> const lock{ mutex_ };
+  run_queue_.push_back( &m );
+  cv_.notify_one();
+}
+
+void thread_executor::main_loop() {
+  unique_lock<mutex> lock{ mutex_ };
+  for (;;) {
+    cv_.wait( lock, [this]() { return stopping_ || !run_queue_.empty(); } );
+    if ( run_queue_.empty() )           // must be stopping
+      return;
+    machine *const m = run_queue_.front();
+    run_queue_.pop_front();
+    //
+    // Don't hold our mutex while running the machine so other threads can
+    // call execute() in the meantime.
+    //
+    lock.unlock();
+    m->run_posted();
+    lock.lock();
+  } // for
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+executor* machine::set_executor( executor *e ) {
+  executor *const old = executor_.exchange( e );
+  if ( old != nullptr )
+    wait_for_unbound_executor();
+  inbox *const ib = inbox_.load( memory_order_acquire );
+  if ( ib != nullptr && !ib->empty() ) {
+    //
+    // There are events posted before the change: make sure whoever is now
+    // responsible for them runs them.
+    //
+    if ( e != nullptr ) {
+      if ( !scheduled_.exchange( true ) )
+        e->execute( *this );
+    }
+    else {
+      drain_inbox_slow();
+    }
+  }
+  return old;
+}
+
+void machine::start_thread() {
+  if ( own_executor_ == nullptr ) {
+    own_executor_ = new thread_executor;
+    set_executor( own_executor_ );
+  }
+}
+
+void machine::stop_thread() {
+  if ( own_executor_ != nullptr ) {
+    //
+    // Unbind from our executor only if we're still bound to it rather than to
+    // one bound since, then wait until no poster can still reach it.  (If
+    // another executor has since been bound, binding it waited.)
+    //
+    executor *e = own_executor_;
+    if ( executor_.compare_exchange_strong( e, nullptr ) )
+      wait_for_unbound_executor();
+    //
+    // Deleting the executor waits for its thread to run us if it was asked to
+    // before we unbound from it.
+    //
+    delete own_executor_;
+    own_executor_ = nullptr;
+    drain_inbox();
+  }
+}
+
+void machine::wait_for_unbound_executor() {
+  //
+  // Wait until no poster that loaded the old executor can still ask it to run
+  // us (so it can be destroyed once we return); then until it's no longer
+  // running us, including any run it has been asked to do but hasn't started
+  // yet (so scheduled_ isn't left set by a request of it).
+  //
+  while ( asking_.load() > 0 )
+    this_thread::yield();
+  while ( scheduled_.load() || running_.load() > 0 )
+    this_thread::yield();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+/* vim:set et sw=2 ts=2: */
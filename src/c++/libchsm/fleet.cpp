@@ -0,0 +1,97 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/fleet.cpp -- Run-Time library implementation
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#define CHSM_NO_ALIAS_NS
+#include "chsm.h"
+
+// standard
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+namespace CHSM_NS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+fleet_base::fleet_base( vector<machine*> &&machines ) :
+  machines_{ std::move( machines ) },
+  words_{ machines_.empty() ? 0 : machines_.front()->config_words_ },
+  configs_( machines_.size() * words_ )
+{
+  config_word *config = configs_.data();
+  for ( machine *const m : machines_ ) {
+    assert( m->config_words_ == words_ );
+    copy_n( m->config_, words_, config );
+    m->config_ = config;
+    config += words_;
+  } // for
+}
+
+fleet_base::~fleet_base() {
+  // out-of-line since configs_ must outlive the machines
+}
+
+vector<size_t> const& fleet_base::select( event const &e ) {
+  //
+  // The event's sources include those of its base events, if any.
+  //
+  config_word const *const sources = e.desc_.sources_;
+
+  selected_.clear();
+  size_t const n = machines_.size();
+  config_word const *const configs = configs_.data();
+
+  if ( words_ == 1 ) {
+    //
+    // The common case of a machine having at most CHSM_CONFIG_WORD_BITS
+    // states: test the machines 64 at a time into a bitmask in a branch-free
+    // loop the compiler can vectorize, then skip whole blocks of machines in
+    // which the event can't take any transition.
+    //
+    config_word const source = sources[0];
+    for ( size_t first = 0; first < n; first += 64 ) {
+      size_t const count = min( n - first, size_t{ 64 } );
+      uint64_t hits = 0;
+      for ( size_t i = 0; i < count; ++i )
+        hits |= uint64_t{ (configs[ first + i ] & source) != 0 } << i;
+      for ( ; hits != 0; hits &= hits - 1 )
+        selected_.push_back( first + __builtin_ctzll( hits ) );
+    } // for
+  }
+  else {
+    for ( size_t i = 0; i < n; ++i ) {
+      config_word const *const config = configs + i * words_;
+      config_word any = 0;
+      for ( unsigned w = 0; w < words_; ++w )
+        any |= config[w] & sources[w];
+      if ( any != 0 )
+        selected_.push_back( i );
+    } // for
+  }
+
+  return selected_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,319 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/inbox.cpp -- Run-Time library implementation
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#define CHSM_NO_ALIAS_NS
+#include "chsm.h"
+#include "inbox.h"
+#include "util.h"
+
+// standard
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <thread>
+
+using namespace std;
+
+namespace CHSM_NS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+machine::inbox::inbox() :
+  enqueue_pos_{ 0 },
+  dequeue_pos_{ 0 },
+  waiters_{ 0 }
+{
+  for ( size_t i = 0; i < CAPACITY; ++i )
+    entry_[i].seq_.store( i, memory_order_relaxed );
+}
+
+machine::inbox::~inbox() {
+  //
+  // Destroy the param_blocks of any events that were posted but never
+  // broadcast.
+  //
+  while ( inbox_entry *const entry = front() ) {
+    if ( entry->event_ != nullptr )
+      static_cast<event::param_block*>( entry->param_block_ )->~param_block();
+    if ( entry->heap_ != nullptr )
+      ::operator delete( entry->heap_ );
+    pop();
+  } // while
+}
+
+machine::inbox_entry* machine::inbox::claim() {
+  size_t pos = enqueue_pos_.load( memory_order_relaxed );
+  for (;;) {
+    inbox_entry *const entry = &entry_[ pos & MASK ];
+    size_t const seq = entry->seq_.load( memory_order_acquire );
+    auto const diff =
+      static_cast<intptr_t>( seq ) - static_cast<intptr_t>( pos );
+    if ( diff == 0 ) {
+      //
+      // The entry is free: try to claim it.  If another producer beat us to
+      // it, pos is updated to the current enqueue position and we try again.
+      //
+      if ( enqueue_pos_.compare_exchange_weak( pos, pos + 1,
+                                               memory_order_relaxed ) ) {
+        return entry;
+      }
+    }
+    else if ( diff < 0 ) {
+      //
+      // The entry still holds an event from the previous lap: we're full.
+      //
+      return nullptr;
+    }
+    else {
+      //
+      // Another producer claimed the entry since we read the position.
+      //
+      pos = enqueue_pos_.load( memory_order_relaxed );
+    }
+  } // for
+}
+
+void machine::inbox::pop() {
+  size_t const pos = dequeue_pos_.load( memory_order_relaxed );
+  entry_[ pos & MASK ].seq_.store( pos + CAPACITY, memory_order_release );
+  //
+  // Both this store and the load of waiters_ are sequentially consistent so
+  // that either we see a waiter or the waiter sees the new position.
+  //
+  dequeue_pos_.store( pos + 1 );
+  if ( waiters_.load() > 0 ) {
+    lock_guard<mutex> const lock{ wait_mutex_ };
+    wait_cv_.notify_all();
+  }
+}
+
+void machine::inbox::wait( ticket t ) {
+  if ( is_popped( t ) )
+    return;
+  ++waiters_;
+  {
+    unique_lock<mutex> lock{ wait_mutex_ };
+    wait_cv_.wait( lock, [this,t]() { return is_popped( t ); } );
+  }
+  --waiters_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void machine::drain_inbox_locked( inbox *ib ) const {
+  while ( inbox_entry *const entry = ib->front() ) {
+    if ( entry->event_ != nullptr ) {
+      //
+      // Since the algorithm isn't in progress, this runs to completion and
+      // the event's param_block is destroyed by the time it returns, so the
+      // entry can be reused.
+      //
+      entry->event_->broadcast( entry->param_block_ );
+    }
+    if ( entry->heap_ != nullptr )
+      ::operator delete( entry->heap_ );
+    ib->pop();
+  } // while
+}
+
+void machine::drain_inbox_slow() const {
+  if ( executor_of() != nullptr )       // only the executor drains
+    return;
+  inbox *const ib = inbox_.load( memory_order_acquire );
+  for (;;) {
+    //
+    // Both the posting thread (right after inbox::publish() stores its
+    // entry's sequence number) and the thread that held the mutex (right
+    // after releasing it) get here, so this fence pairs with the very same
+    // fence executed by the other thread: either the releasing thread sees
+    // the newly published entry below or the posting thread's try_lock() sees
+    // the mutex released (and it drains the inbox itself).
+    //
+    atomic_thread_fence( memory_order_seq_cst );
+    if ( ib->empty() )
+      return;
+
+    lock_type const lock{ mutex_, try_to_lock };
+    if ( !lock ) {
+      //
+      // Another thread holds the mutex: it will drain the inbox just before
+      // releasing it.
+      //
+      return;
+    }
+    if ( in_progress_ ) {
+      //
+      // We're being called (indirectly) from an action in the middle of the
+      // transition algorithm: the outermost broadcast will drain the inbox
+      // once the algorithm completes.
+      //
+      return;
+    }
+
+    //
+    // Drain the entire inbox, not just up to our own entry: the producers of
+    // any entries after ours returned when their try_lock() failed, so
+    // nobody else may ever drain them.  (They can't wait for the mutex
+    // instead: two machines posting to each other from their actions would
+    // deadlock.)
+    //
+    drain_inbox_locked( ib );
+  } // for
+}
+
+bool machine::ask_executor() {
+  //
+  // Announce ourselves before loading the executor: set_executor() exchanges
+  // the executor before waiting for asking_ to be 0, so either it sees us and
+  // waits or we load the new executor.
+  //
+  ++asking_;
+  executor *const e = executor_.load();
+  //
+  // The exchange pairs with the one in run_posted(): either the executor sees
+  // the entry just published or we ask it to run us again.
+  //
+  if ( e != nullptr && !scheduled_.exchange( true ) )
+    e->execute( *this );
+  --asking_;                            // must be the last use of e
+  return e != nullptr;
+}
+
+machine::inbox* machine::inbox_of() {
+  inbox *ib = inbox_.load( memory_order_acquire );
+  if ( unlikely( ib == nullptr ) ) {
+    inbox *const new_ib = new inbox;
+    if ( inbox_.compare_exchange_strong( ib, new_ib ) ) {
+      ib = new_ib;
+      //
+      // Acquire and release the mutex once so that any thread that currently
+      // holds it is guaranteed to see the inbox when it releases it.
+      //
+      lock_type const lock{ mutex_ };
+    }
+    else {
+      //
+      // Another thread created the inbox first: ib is now that inbox.
+      //
+      delete new_ib;
+    }
+  }
+  return ib;
+}
+
+machine::inbox_entry* machine::inbox_claim() {
+  inbox *const ib = inbox_of();
+  for (;;) {
+    if ( inbox_entry *const entry = ib->claim() ) {
+      entry->event_ = nullptr;
+      entry->heap_ = nullptr;
+      return entry;
+    }
+
+    //
+    // The inbox is full: help drain it (or poke the executor), then yield to
+    // whichever thread is draining it.  However, if we can acquire the
+    // (recursive) mutex while the algorithm is in progress, it means we're
+    // being called from one of our own actions: nobody can drain the inbox
+    // until we return, so we'd wait forever.  (Without a lock, there's no
+    // telling whether it's us or the executor's thread that's in progress.)
+    //
+    if ( mutex_.policy() != lock_policy::NONE ) {
+      lock_type const lock{ mutex_, try_to_lock };
+      assert( !(lock && in_progress_) );
+    }
+    if ( !ask_executor() )
+      drain_inbox_slow();
+    this_thread::yield();
+  } // for
+}
+
+machine::ticket machine::inbox_publish( inbox_entry *entry ) {
+  //
+  // The entry's sequence number is its position in the inbox at the time it
+  // was claimed; the entry has been consumed once the dequeue position has
+  // moved past it.
+  //
+  ticket const t = entry->seq_.load( memory_order_relaxed ) + 1;
+  inbox::publish( entry );
+  if ( !ask_executor() )
+    drain_inbox_slow();
+  return t;
+}
+
+bool machine::post_timeout( timeout_event &t, uint64_t generation ) {
+  typedef timeout_event::param_block param_block;
+  static_assert(
+    sizeof( param_block ) <= CHSM_INBOX_BLOCK_SIZE,
+    "CHSM_INBOX_BLOCK_SIZE is too small for a timeout_event::param_block"
+  );
+
+  inbox_entry *const entry = inbox_of()->claim();
+  if ( entry == nullptr )
+    return false;
+  entry->heap_ = nullptr;
+  entry->param_block_ = new( entry->storage_ ) param_block( t, generation );
+  entry->event_ = &t;
+  inbox::publish( entry );
+  ask_executor();
+  return true;
+}
+
+bool machine::is_done( ticket t ) const {
+  inbox *const ib = inbox_.load( memory_order_acquire );
+  return ib == nullptr || ib->is_popped( t );
+}
+
+void machine::run_posted() {
+  inbox *const ib = inbox_.load( memory_order_acquire );
+  if ( ib == nullptr )
+    return;
+  ++running_;
+  for (;;) {
+    {
+      lock_type const lock{ mutex_ };
+      if ( !in_progress_ )
+        drain_inbox_locked( ib );
+    }
+    //
+    // The flag is cleared only after draining so that no other thread of the
+    // executor is asked to run us while we're still running.  Having cleared
+    // it, though, we must check whether an event was posted in the meantime:
+    // if so, and no producer has (re)scheduled us yet, we run again.  The
+    // fence pairs with the exchange in inbox_publish().
+    //
+    scheduled_.store( false );
+    atomic_thread_fence( memory_order_seq_cst );
+    if ( ib->empty() || scheduled_.exchange( true ) )
+      break;
+  } // for
+  --running_;                           // must be the last use of this
+}
+
+void machine::wait( ticket t ) const {
+  if ( inbox *const ib = inbox_.load( memory_order_acquire ) )
+    ib->wait( t );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,169 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/inbox.h -- Run-Time library declarations
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef chsm_inbox_H
+#define chsm_inbox_H
+
+// local
+#include "chsm.h"
+
+// standard
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+/**
+ * The number of entries in a machine's inbox.  It must be a power of 2.
+ */
+#ifndef CHSM_INBOX_CAPACITY
+#define CHSM_INBOX_CAPACITY       256
+#endif /* CHSM_INBOX_CAPACITY */
+
+namespace CHSM_NS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @internal
+ *
+ * An %inbox is a bounded, lock-free, multi-producer, single-consumer queue of
+ * posted events.  Each entry has a sequence number that says whether it's
+ * free for producers or full for the consumer (see Dmitry Vyukov's "bounded
+ * MPMC queue").  Producers never block one another: a producer claims an
+ * entry with a single compare-and-swap, constructs the event's param_block
+ * directly in it, and publishes it.
+ *
+ * There is only ever one consumer at a time since the consumer functions are
+ * only ever called while holding the machine's mutex.
+ */
+class machine::inbox {
+public:
+  inbox();
+  ~inbox();
+
+  /**
+   * Claims a free entry.
+   *
+   * @return Returns said entry or null if the %inbox is full.
+   */
+  inbox_entry* claim();
+
+  /**
+   * Publishes a claimed entry making it visible to the consumer.
+   *
+   * @param entry The entry to publish.
+   */
+  static void publish( inbox_entry *entry ) {
+    entry->seq_.store(
+      entry->seq_.load( std::memory_order_relaxed ) + 1,
+      std::memory_order_release
+    );
+  }
+
+  /**
+   * Gets the oldest published entry.
+   *
+   * @return Returns said entry or null if the %inbox is empty.
+   */
+  inbox_entry* front() {
+    return peek( 0 );
+  }
+
+  /**
+   * Gets a published entry without popping it.
+   *
+   * @param n The number of entries after the oldest published one.
+   * @return Returns said entry or null if fewer than \a n + 1 entries have
+   * been published.
+   */
+  inbox_entry* peek( std::size_t n ) {
+    if ( n >= CAPACITY )
+      return nullptr;
+    std::size_t const pos = dequeue_pos_.load( std::memory_order_relaxed ) + n;
+    inbox_entry *const entry = &entry_[ pos & MASK ];
+    return entry->seq_.load( std::memory_order_acquire ) == pos + 1 ?
+      entry : nullptr;
+  }
+
+  /**
+   * Gets whether the %inbox has no published entries.
+   *
+   * @return Returns `true` only if the %inbox is empty.
+   */
+  bool empty() {
+    return front() == nullptr;
+  }
+
+  /**
+   * Gets whether the entry having the given ticket has been popped.
+   *
+   * @param t The ticket.
+   * @return Returns `true` only if said entry has been popped.
+   */
+  bool is_popped( ticket t ) const {
+    return dequeue_pos_.load() >= t;
+  }
+
+  /**
+   * Frees the oldest published entry returned by front() and notifies any
+   * threads waiting for it.
+   */
+  void pop();
+
+  /**
+   * Waits for the entry having the given ticket to be popped.
+   *
+   * @param t The ticket.
+   */
+  void wait( ticket t );
+
+private:
+  static std::size_t const CAPACITY = CHSM_INBOX_CAPACITY;
+  static std::size_t const MASK = CAPACITY - 1;
+  static_assert( (CAPACITY & MASK) == 0, "capacity must be a power of 2" );
+
+  inbox_entry entry_[ CAPACITY ];
+
+  /**
+   * The enqueue and dequeue positions are on their own cache lines so that
+   * producers don't contend with the consumer.
+   */
+  alignas(64) std::atomic<std::size_t> enqueue_pos_;
+  alignas(64) std::atomic<std::size_t> dequeue_pos_;
+
+  /**
+   * The number of threads in wait().  It's used so that pop() needn't bother
+   * with the mutex and condition variable when there are no waiters.
+   */
+  std::atomic<unsigned>   waiters_;
+  std::mutex              wait_mutex_;
+  std::condition_variable wait_cv_;
+
+  inbox( inbox const& ) = delete;
+  inbox& operator=( inbox const& ) = delete;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+
+#endif /* chsm_inbox_H */
+/* vim:set et sw=2 ts=2: */
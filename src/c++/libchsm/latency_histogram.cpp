@@ -0,0 +1,113 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/latency_histogram.cpp -- Run-Time library implementation
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#define CHSM_NO_ALIAS_NS
+#include "chsm.h"
+
+// standard
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace CHSM_NS {
+
+#ifndef CHSM_NO_METRICS
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Gets the position of the most significant 1 bit of a number.
+ *
+ * @param n The number.  It must not be 0.
+ * @return Returns said position where 0 is the least significant bit.
+ */
+static inline unsigned msb( uint64_t n ) {
+#ifdef __GNUC__
+  return 63 - __builtin_clzll( n );
+#else
+  unsigned i = 0;
+  while ( n >>= 1 )
+    ++i;
+  return i;
+#endif /* __GNUC__ */
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned latency_histogram::bucket_of( uint64_t ns ) {
+  if ( ns < SUB_BUCKETS )
+    return static_cast<unsigned>( ns );
+  //
+  // The bucket is determined by the position of the most significant 1 bit
+  // (which power of 2) and by the SUB_BUCKET_BITS bits after it (which linear
+  // sub-bucket of that power of 2).
+  //
+  unsigned const shift = msb( ns ) - SUB_BUCKET_BITS;
+  unsigned const sub = (ns >> shift) & (SUB_BUCKETS - 1);
+  return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t latency_histogram::bucket_max( unsigned bucket ) {
+  if ( bucket < SUB_BUCKETS )
+    return bucket;
+  unsigned const shift = bucket / SUB_BUCKETS - 1;
+  uint64_t const sub = bucket % SUB_BUCKETS;
+  return ((SUB_BUCKETS + sub) << shift) + ((uint64_t{ 1 } << shift) - 1);
+}
+
+uint64_t latency_histogram::count() const {
+  uint64_t n = 0;
+  for ( auto const &bucket : buckets_ )
+    n += bucket.get();
+  return n;
+}
+
+uint64_t latency_histogram::percentile( double q ) const {
+  //
+  // Take one pass to copy the buckets so the count and percentile are
+  // consistent with each other even if latencies are being recorded.
+  //
+  uint64_t counts[ BUCKETS ];
+  uint64_t total = 0;
+  for ( unsigned i = 0; i < BUCKETS; ++i )
+    total += (counts[i] = buckets_[i].get());
+  if ( total == 0 )
+    return 0;
+
+  q = q < 0 ? 0 : q > 1 ? 1 : q;
+  uint64_t const rank = max( uint64_t{ 1 },
+    static_cast<uint64_t>( ceil( q * static_cast<double>( total ) ) )
+  );
+
+  uint64_t n = 0;
+  for ( unsigned i = 0; i < BUCKETS; ++i )
+    if ( (n += counts[i]) >= rank )
+      return bucket_max( i );
+  return bucket_max( BUCKETS - 1 );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif /* CHSM_NO_METRICS */
+
+} // namespace
+/* vim:set et sw=2 ts=2: */
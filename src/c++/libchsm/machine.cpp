@@ -21,8 +21,19 @@
 // local
 #define CHSM_NO_ALIAS_NS
 #include "chsm.h"
+#include "inbox.h"
 #include "util.h"
 
+// standard
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+
 using namespace std;
 
 namespace CHSM_NS {
@@ -32,8 +43,26 @@ static unsigned const DEBUG_INDENT_SIZE = 2;  // spaces per indent
 state const *const  machine::NIL_         = nullptr;
 state::id const     machine::NO_STATE_ID_ = -1;
 
+static event::descriptor const PRIME_DESCRIPTOR {
+  "<prime>", nullptr, nullptr, nullptr, nullptr, 0
+};
+
 event const         machine::PRIME_EVENT_
-                      ( nullptr, nullptr, "<prime>", nullptr );
+                      ( nullptr, PRIME_DESCRIPTOR, nullptr );
+
+/**
+ * The threads waiting in wait_until_any() for a machine's configuration to be
+ * published.
+ */
+struct machine::config_waiters {
+  /**
+   * The number of threads waiting.  It's used so that publish_config()
+   * needn't bother with the mutex and condition variable when there are none.
+   */
+  atomic<unsigned>    count_{ 0 };
+  mutex               mutex_;
+  condition_variable  cv_;
+};
 
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -44,18 +73,46 @@ machine::machine( CHSM_MACHINE_ARGS ) :
   transitions_in_machine_{ chsm_transitions_in_machine_ },
   taken_{ chsm_taken_ },
   target_{ chsm_target_ },
+  config_{ chsm_config_ },
+  config_words_{ chsm_config_words_ },
+  config_seq_{ 0 },
+  published_{ new atomic<config_word>[ 2 * chsm_config_words_ ]() },
+  config_waiters_{ nullptr },
   in_progress_{ false },
   debug_indent_{ 0 },
-  debug_state_{ DEBUG_NONE }
+  debug_state_{ DEBUG_NONE },
+  events_{ nullptr },
+#ifndef CHSM_NO_METRICS
+  transitions_taken_{ new metric[ chsm_transitions_in_machine_ ] },
+  clock_ns_{ 0 },
+  record_latency_{ false },
+#endif /* CHSM_NO_METRICS */
+  trace_buf_{ nullptr },
+  trace_mask_{ 0 },
+  trace_head_{ 0 },
+  inbox_{ nullptr },
+  executor_{ nullptr },
+  own_executor_{ nullptr },
+  scheduled_{ false },
+  running_{ 0 },
+  asking_{ 0 }
 {
   for ( unsigned i = 0; i < transitions_in_machine_; ++i ) {
     taken_[i] = nullptr;
     target_[i] = nullptr;
   } // for
+  fill_n( config_, config_words_, 0 );
 }
 
 machine::~machine() {
-  // out-of-line since it's virtual
+  stop_thread();
+  delete inbox_.load( memory_order_acquire );
+  delete[] trace_buf_;
+  delete[] published_;
+  delete config_waiters_.load( memory_order_acquire );
+#ifndef CHSM_NO_METRICS
+  delete[] transitions_taken_;
+#endif /* CHSM_NO_METRICS */
 }
 
 void machine::algorithm() {
@@ -63,15 +120,26 @@ void machine::algorithm() {
     return;
   in_progress_ = true;
 
-  if ( is_debug( DEBUG_ALGORITHM ) ) {
-    dout() << "ALGORITHM BEGINNING" ENDL;
+  if ( is_tracing() ) {
+    emit_trace( TRACE_ALGORITHM_BEGIN, nullptr );
     ++debug_indent_;
   }
 
   while ( !event_queue_.empty() ) {
+    //
+    // The events of the current micro-step are those at positions [0,
+    // events_in_step) of the queue.  Events broadcast during the micro-step
+    // are appended after them, which may move them, so they're accessed by
+    // position rather than by pointer.
+    //
     event_queue::size_type const events_in_step = event_queue_.size();
     event_queue::size_type i;
-    event_queue::iterator e_it;
+
+#ifndef CHSM_NO_METRICS
+    ++micro_steps_;
+    micro_step_events_.add( events_in_step );
+    max_micro_step_events_.max( events_in_step );
+#endif /* CHSM_NO_METRICS */
 
     //
     // Phase I: Exit the "from" states
@@ -83,25 +151,22 @@ void machine::algorithm() {
     // of children since the CHSM-to-C++ compiler defines transitions in just
     // the right order.
     //
-    if ( is_debug( DEBUG_ALGORITHM ) ) {
-      dout() << "events in micro-step: " << events_in_step ENDL;
-      dout() << "ALGORITHM PHASE I: Exit \"from\" states" ENDL;
+    if ( is_tracing() ) {
+      emit_trace( TRACE_MICRO_STEP, nullptr, events_in_step );
+      emit_trace( TRACE_PHASE_I, nullptr );
       ++debug_indent_;
     }
 
-    for ( i = 0, e_it = event_queue_.begin(); i < events_in_step;
-          ++i, ++e_it ) {
-      event const &cur_event = **e_it;
+    for ( i = 0; i < events_in_step; ++i ) {
+      event const &cur_event = *event_queue_[i];
       //
-      // Set our base events' param_blocks to share ours.
+      // Other events of the micro-step may share our param_block_ (see its
+      // comment), so (re)point it at ours.
       //
-      for ( auto base = cur_event.base_event_; base != nullptr;
-            base = base->base_event_ ) {
-        base->param_block_ = cur_event.param_block_;
-      } // for
+      cur_event.param_block_ = cur_event.own_param_block_;
 
-      if ( is_debug( DEBUG_ALGORITHM ) ) {
-        dout() << "iterating transitions of: " << cur_event.name() ENDL;
+      if ( is_tracing() ) {
+        emit_trace( TRACE_ITERATING, &cur_event );
         ++debug_indent_;
       }
 
@@ -117,14 +182,16 @@ void machine::algorithm() {
           taken_[ t.id() ] = nullptr;
           continue;
         }
-
-        if ( is_debug( DEBUG_ALGORITHM ) ) {
-          if ( !t->is_internal() ) {
-            dout()
-              << "performing: " << from->name() << " -> "
-              << target_[ t.id() ]->name()
-            ENDL;
-          }
+#ifndef CHSM_NO_METRICS
+        ++transitions_taken_[ t.id() ];
+#endif /* CHSM_NO_METRICS */
+
+        if ( is_tracing() ) {
+          if ( !t->is_internal() )
+            emit_trace(
+              TRACE_PERFORMING, &cur_event, t.id(),
+              target_[ t.id() ]->desc_.id_
+            );
           ++debug_indent_;
         }
 
@@ -132,10 +199,14 @@ void machine::algorithm() {
         // If the transition isn't internal, exit the "from" state.  If it
         // actually exited and there's an action to perform, perform it.
         //
-        if ( (t->is_internal() || from->exit( cur_event, target_[ t.id() ] ))
-             && t->action_ != nullptr ) {
-          if ( is_debug( DEBUG_ALGORITHM ) ) {
-            dout() << "performing action" ENDL;
+        bool const exited = t->is_internal() || (
+          t->exit_path_ != nullptr ?
+            exit_path( cur_event, from, t->exit_path_ ) :
+            from->exit( cur_event, target_[ t.id() ] )
+        );
+        if ( exited && t->action_ != nullptr ) {
+          if ( is_tracing() ) {
+            emit_trace( TRACE_ACTION, &cur_event, t.id() );
             ++debug_indent_;
           }
 
@@ -148,15 +219,15 @@ void machine::algorithm() {
             //
           }
 
-          if ( is_debug( DEBUG_ALGORITHM ) )
+          if ( is_tracing() )
             --debug_indent_;
         }
 
-        if ( is_debug( DEBUG_ALGORITHM ) )
+        if ( is_tracing() )
           --debug_indent_;
       } // for
 
-      if ( is_debug( DEBUG_ALGORITHM ) )
+      if ( is_tracing() )
         --debug_indent_;
     } // for
 
@@ -166,17 +237,17 @@ void machine::algorithm() {
     // Iterate through all the events and their transitions again to enter the
     // inactive "to" states.  Also unmark the transitions.
     //
-    if ( is_debug( DEBUG_ALGORITHM ) ) {
+    if ( is_tracing() ) {
       --debug_indent_;
-      dout() << "ALGORITHM PHASE II: Enter \"to\" states" ENDL;
+      emit_trace( TRACE_PHASE_II, nullptr );
       ++debug_indent_;
     }
 
-    for ( i = 0, e_it = event_queue_.begin(); i < events_in_step;
-          ++i, ++e_it ) {
-      event const &cur_event = **e_it;
-      if ( is_debug( DEBUG_ALGORITHM ) ) {
-        dout() << "iterating transitions of: " << cur_event.name() ENDL;
+    for ( i = 0; i < events_in_step; ++i ) {
+      event const &cur_event = *event_queue_[i];
+      cur_event.param_block_ = cur_event.own_param_block_;
+      if ( is_tracing() ) {
+        emit_trace( TRACE_ITERATING, &cur_event );
         ++debug_indent_;
       }
 
@@ -184,13 +255,12 @@ void machine::algorithm() {
         if ( taken_[ t.id() ] != &cur_event )
           continue;
 
-        if ( is_debug( DEBUG_ALGORITHM ) ) {
-          if ( !t->is_internal() ) {
-            dout()
-              << "performing: " << state_[ t->from_id_ ]->name() << " -> "
-              << target_[ t.id() ]->name()
-            ENDL;
-          }
+        if ( is_tracing() ) {
+          if ( !t->is_internal() )
+            emit_trace(
+              TRACE_PERFORMING, &cur_event, t.id(),
+              target_[ t.id() ]->desc_.id_
+            );
           ++debug_indent_;
         }
 
@@ -199,15 +269,18 @@ void machine::algorithm() {
           // This is a real transition as opposed to an internal one -- enter
           // the "to" state.
           //
-          target_[ t.id() ]->enter( cur_event );
+          if ( t->enter_path_ != nullptr )
+            enter_path( cur_event, t->enter_path_ );
+          else
+            target_[ t.id() ]->enter( cur_event );
         }
         taken_[ t.id() ] = nullptr;
 
-        if ( is_debug( DEBUG_ALGORITHM ) )
+        if ( is_tracing() )
           --debug_indent_;
       } // for
 
-      if ( is_debug( DEBUG_ALGORITHM ) )
+      if ( is_tracing() )
         --debug_indent_;
     } // for
 
@@ -217,33 +290,123 @@ void machine::algorithm() {
     // All the events in the current micro-step have now been processed --
     // remove them from the queue.
     //
-    if ( is_debug( DEBUG_ALGORITHM ) ) {
+    if ( is_tracing() ) {
       --debug_indent_;
-      dout() << "ALGORITHM PHASE III: Dequeue events" ENDL;
+      emit_trace( TRACE_PHASE_III, nullptr );
       ++debug_indent_;
     }
 
+#ifndef CHSM_NO_METRICS
+    //
+    // Read the clock only once per micro-step: it's both when all of its
+    // events completed and (approximately) when any events broadcast during
+    // the next micro-step were queued.
+    //
+    if ( record_latency_ )
+      clock_ns_ = read_clock_ns();
+#endif /* CHSM_NO_METRICS */
+
     for ( i = 0; i < events_in_step; ++i ) {
-      event &cur_event = *event_queue_.front();
+      event &cur_event = *event_queue_[i];
+#ifndef CHSM_NO_METRICS
+      if ( record_latency_ )
+        cur_event.record_latency(
+          clock_ns_ - cur_event.extras_of().queued_ns_
+        );
+#endif /* CHSM_NO_METRICS */
       cur_event.broadcasted();
-      event_queue_.pop_front();
 
-      if ( is_debug( DEBUG_EVENTS ) )
-        dout() << "dequeued: " << cur_event.name() ENDL;
+      if ( is_tracing() )
+        emit_trace( TRACE_DEQUEUED, &cur_event );
     } // for
+    event_queue_.pop_front( events_in_step );
+    publish_config();
 
-    if ( is_debug( DEBUG_ALGORITHM ) )
+    if ( is_tracing() )
       --debug_indent_;
   } // while
 
   in_progress_ = false;
 
-  if ( is_debug( DEBUG_ALGORITHM ) ) {
+  if ( is_tracing() ) {
     --debug_indent_;
-    dout() << "ALGORITHM COMPLETE" ENDL;
+    emit_trace( TRACE_ALGORITHM_END, nullptr );
   }
 }
 
+void machine::broadcast_batch( batch &b ) {
+  if ( b.empty() )
+    return;
+  {
+    event::machine_lock const lock{ *this };
+    assert( !in_progress_ );
+
+    //
+    // Pretend the algorithm is in progress so that each broadcast merely
+    // queues its event rather than running the algorithm itself; the
+    // algorithm then takes all of their transitions in one micro-step.
+    //
+    in_progress_ = true;
+#ifndef CHSM_NO_METRICS
+    if ( record_latency_ )
+      clock_ns_ = read_clock_ns();
+#endif /* CHSM_NO_METRICS */
+    for ( auto const &entry : b.entries_ )
+      entry.event_->broadcast( entry.param_block_ );
+    in_progress_ = false;
+
+    algorithm();
+  }
+  //
+  // All the param_blocks have been destroyed by now, so the batch can just
+  // forget about them.
+  //
+  b.reset();
+}
+
+void machine::event_queue::make_room() {
+  size_type const n = size();
+  if ( head_ >= capacity_ / 2 ) {
+    //
+    // At least half the queue is free at the front: slide the events down.
+    //
+    std::copy( buf_ + head_, buf_ + tail_, buf_ );
+  }
+  else {
+    event **const new_buf = new event*[ capacity_ * 2 ];
+    std::copy( buf_ + head_, buf_ + tail_, new_buf );
+    if ( buf_ != inline_buf_ )
+      delete[] buf_;
+    buf_ = new_buf;
+    capacity_ *= 2;
+  }
+  head_ = 0;
+  tail_ = n;
+}
+
+void machine::enter_path( event const &trigger, state::id const *path ) {
+  for ( ; *path != NO_STATE_ID_; ++path ) {
+    //
+    // Tell each parent which of its children is being entered directly so
+    // that it doesn't enter its default child instead.
+    //
+    state *const s = state_[ path[0] ];
+    state *const child = path[1] != NO_STATE_ID_ ? state_[ path[1] ] : nullptr;
+    if ( !s->enter( trigger, child ) && !s->active() )
+      break;
+  } // for
+}
+
+bool machine::exit_path( event const &trigger, state *from,
+                         state::id const *path ) {
+  if ( !from->exit( trigger ) )
+    return false;
+  for ( ; *path != NO_STATE_ID_; ++path )
+    if ( !state_[ *path ]->exit( trigger ) )
+      break;
+  return true;
+}
+
 ostream& machine::dout() const {
   cerr << '|';
   for ( unsigned i = debug_indent_ * DEBUG_INDENT_SIZE; i > 0; --i )
@@ -251,21 +414,460 @@ ostream& machine::dout() const {
   return cerr;
 }
 
+void machine::config( configuration &c ) const {
+  event::machine_lock const lock{ *this };
+  c.words_.assign( config_, config_ + config_words_ );
+}
+
+machine::configuration machine::config() const {
+  configuration c;
+  config( c );
+  return c;
+}
+
+bool machine::is_config( configuration const &c ) const {
+  event::machine_lock const lock{ *this };
+  return c.size() == config_words_ &&
+         equal( config_, config_ + config_words_, c.data() );
+}
+
+template<class ReadFn>
+void machine::read_published( ReadFn read ) const {
+  for (;;) {
+    uint64_t const seq = config_seq_.load( memory_order_acquire );
+    uint64_t const n = seq / 2;         // most recent complete publication
+    read( published_ + n % 2 * config_words_ );
+    //
+    // This fence pairs with the one in publish_config(): if we read anything
+    // written for publication n + 2, we see its odd sequence number below.
+    //
+    atomic_thread_fence( memory_order_acquire );
+    if ( config_seq_.load( memory_order_relaxed ) < 2 * n + 3 )
+      return;
+  } // for
+}
+
+void machine::publish_config() {
+  //
+  // Readers of publication n can carry on while publication n + 1 is being
+  // written into the other buffer; only once publication n + 2 starts being
+  // written into theirs must they retry.  The release store makes publication
+  // n visible to readers that see the odd sequence number; the fence keeps
+  // the stores below from being seen before it.
+  //
+  uint64_t const seq = config_seq_.load( memory_order_relaxed ) + 1;
+  config_seq_.store( seq, memory_order_release );
+  atomic_thread_fence( memory_order_release );
+  atomic<config_word> *const buf =
+    published_ + (seq + 1) / 2 % 2 * config_words_;
+  for ( unsigned i = 0; i < config_words_; ++i )
+    buf[i].store( config_[i], memory_order_relaxed );
+  //
+  // Both this store and the loads below are sequentially consistent so that
+  // either we see a waiter or the waiter sees the new publication.
+  //
+  config_seq_.store( seq + 1 );
+  if ( config_waiters *const w = config_waiters_.load() ) {
+    if ( w->count_.load() > 0 ) {
+      lock_guard<mutex> const lock{ w->mutex_ };
+      w->cv_.notify_all();
+    }
+  }
+}
+
+bool machine::published_active( state::id id ) const {
+  bool is_active = false;
+  read_published( [&]( atomic<config_word> const *buf ) {
+    if ( id < 0 ) {
+      is_active = false;
+      for ( unsigned i = 0; i < config_words_ && !is_active; ++i )
+        is_active = buf[i].load( memory_order_relaxed ) != 0;
+    }
+    else {
+      config_word const w =
+        buf[ id / CHSM_CONFIG_WORD_BITS ].load( memory_order_relaxed );
+      is_active = (w & config_word{ 1 } << id % CHSM_CONFIG_WORD_BITS) != 0;
+    }
+  } );
+  return is_active;
+}
+
+void machine::published_config( configuration &c ) const {
+  c.words_.resize( config_words_ );
+  read_published( [&]( atomic<config_word> const *buf ) {
+    for ( unsigned i = 0; i < config_words_; ++i )
+      c.words_[i] = buf[i].load( memory_order_relaxed );
+  } );
+}
+
+machine::configuration machine::published_config() const {
+  configuration c;
+  published_config( c );
+  return c;
+}
+
+state const* machine::wait_until_any( initializer_list<state const*> states,
+                                      chrono::nanoseconds timeout ) {
+  auto const find_active = [&]() -> state const* {
+    for ( state const *const s : states )
+      if ( published_active( s->desc_.id_ ) )
+        return s;
+    return nullptr;
+  };
+
+  state const *found = find_active();
+  if ( found != nullptr || timeout.count() <= 0 )
+    return found;
+
+  config_waiters *w = config_waiters_.load( memory_order_acquire );
+  if ( w == nullptr ) {
+    config_waiters *const new_w = new config_waiters;
+    if ( config_waiters_.compare_exchange_strong( w, new_w ) )
+      w = new_w;
+    else                                // another thread created them first
+      delete new_w;
+  }
+
+  ++w->count_;
+  //
+  // This fence pairs with the sequentially consistent store and loads in
+  // publish_config(): either it sees us waiting or we see its publication.
+  //
+  atomic_thread_fence( memory_order_seq_cst );
+  {
+    unique_lock<mutex> lock{ w->mutex_ };
+    auto const is_found = [&]() { return (found = find_active()) != nullptr; };
+    if ( timeout == chrono::nanoseconds::max() )
+      w->cv_.wait( lock, is_found );
+    else
+      w->cv_.wait_for( lock, timeout, is_found );
+  }
+  --w->count_;
+  return found;
+}
+
+size_t machine::configuration::count() const {
+  size_t n = 0;
+  for ( config_word w : words_ )
+    for ( ; w != 0; w &= w - 1 )
+      ++n;
+  return n;
+}
+
+size_t machine::configuration::hash() const {
+  size_t h = words_.size();
+  for ( config_word const w : words_ )
+    h ^= std::hash<config_word>()( w ) + 0x9e3779b9 + (h << 6) + (h >> 2);
+  return h;
+}
+
 void machine::dump_state() const {
-  lock_type const lock{ mutex_ };
-  dout() << "current state:" ENDL;
+  //
+  // Don't use dout() since debug_indent_ belongs to whichever thread is
+  // running the transition algorithm.
+  //
+  configuration const c{ published_config() };
+  cerr << "|current state:" ENDL;
   for ( auto const &state : *this )
-    dout() << ' ' << (state.active() ? '*' : ' ') << state.name() ENDL;
+    cerr << "| " << (c.test( state.desc_.id_ ) ? '*' : ' ') << state.name()
+         ENDL;
+}
+
+/**
+ * Prints a trace record as the same text that the debugging states print.
+ *
+ * @tparam StateNameFn The type of \a state_name.
+ * @tparam FromIdFn The type of \a from_id.
+ * @param o The ostream to print to.
+ * @param r The trace record to print.
+ * @param indent The debugging indentation to use.
+ * @param state_name Given a state ID (or -1 for the root), gets its name.
+ * @param event_name The name of the record's event, if any.
+ * @param from_id Given a transition ID, gets the ID of its "from" state.
+ */
+template<class StateNameFn,class FromIdFn>
+static void print_trace_record( ostream &o, machine::trace_record const &r,
+                                unsigned indent, StateNameFn state_name,
+                                char const *event_name, FromIdFn from_id ) {
+  o << '|';
+  for ( unsigned i = indent * DEBUG_INDENT_SIZE; i > 0; --i )
+    o << ' ';
+
+  switch ( r.kind_ ) {
+    case machine::TRACE_ENTER:
+      o << "entering: " << state_name( r.state_ );
+      break;
+    case machine::TRACE_EXIT:
+      o << "exiting : " << state_name( r.state_ );
+      break;
+    case machine::TRACE_BROADCAST:
+      o << "broadcast: " << event_name;
+      break;
+    case machine::TRACE_CANCELLED:
+      o << "broadcast: " << event_name << " -- cancelled";
+      break;
+    case machine::TRACE_CHECKING:
+      o << "+ checking transitions";
+      break;
+    case machine::TRACE_DEQUEUED:
+      o << "dequeued: " << event_name;
+      break;
+    case machine::TRACE_FOUND:
+      o << "+ found  : " << state_name( from_id( r.transition_ ) );
+      if ( r.state_ != -1 )
+        o << " -> " << state_name( r.state_ );
+      else
+        o << " (internal)";
+      break;
+    case machine::TRACE_PARKED:
+      o << "broadcast: " << event_name << " -- parked";
+      break;
+    case machine::TRACE_PRECONDITION:
+      o << "+ precondition: " << (r.transition_ ? "true" : "false");
+      break;
+    case machine::TRACE_QUEUED:
+      o << "queued   : " << event_name;
+      break;
+    case machine::TRACE_ACTION:
+      o << "performing action";
+      break;
+    case machine::TRACE_ALGORITHM_BEGIN:
+      o << "ALGORITHM BEGINNING";
+      break;
+    case machine::TRACE_ALGORITHM_END:
+      o << "ALGORITHM COMPLETE";
+      break;
+    case machine::TRACE_ITERATING:
+      o << "iterating transitions of: " << event_name;
+      break;
+    case machine::TRACE_MICRO_STEP:
+      o << "events in micro-step: " << r.transition_;
+      break;
+    case machine::TRACE_PERFORMING:
+      o << "performing: "
+        << state_name( from_id( r.transition_ ) ) << " -> "
+        << state_name( r.state_ );
+      break;
+    case machine::TRACE_PHASE_I:
+      o << "ALGORITHM PHASE I: Exit \"from\" states";
+      break;
+    case machine::TRACE_PHASE_II:
+      o << "ALGORITHM PHASE II: Enter \"to\" states";
+      break;
+    case machine::TRACE_PHASE_III:
+      o << "ALGORITHM PHASE III: Dequeue events";
+      break;
+  } // switch
+  o << endl;
+}
+
+void machine::dump_trace( ostream &o ) const {
+  trace_symbols const s{ symbols() };
+  for ( auto const &r : trace_records() )
+    print_trace( o, r, s );
+}
+
+void machine::emit_trace( trace_kind kind, event const *e,
+                          transition::id value, state::id sid ) {
+  trace_record r;
+  r.time_ = 0;
+  r.event_ = e != nullptr ? e->id_ : -1;
+  r.transition_ = value;
+  r.state_ = sid;
+  r.kind_ = kind;
+  r.indent_ = static_cast<uint8_t>( debug_indent_ );
+
+#ifndef CHSM_NO_TRACE
+  if ( trace_buf_ != nullptr ) {
+    r.time_ = static_cast<uint64_t>( clock::read().count() );
+    uint64_t words[ sizeof trace_buf_->words_ / sizeof( uint64_t ) ] = { };
+    ::memcpy( words, &r, sizeof r );
+
+    uint64_t const n = trace_head_.fetch_add( 1, memory_order_relaxed );
+    trace_slot &slot = trace_buf_[ n & trace_mask_ ];
+    slot.seq_.store( 2 * n + 1, memory_order_relaxed );
+    //
+    // This fence orders the store of the odd sequence number before those of
+    // the words so that a reader that sees any of the new words then sees the
+    // sequence number change.
+    //
+    atomic_thread_fence( memory_order_release );
+    for ( size_t i = 0; i < sizeof words / sizeof words[0]; ++i )
+      slot.words_[i].store( words[i], memory_order_relaxed );
+    slot.seq_.store( 2 * n + 2, memory_order_release );
+  }
+#endif /* CHSM_NO_TRACE */
+
+#ifndef CHSM_NO_DEBUG
+  debug_mask const mask =
+    kind <= TRACE_EXIT   ? DEBUG_ENTER_EXIT :
+    kind <= TRACE_QUEUED ? DEBUG_EVENTS     :
+                           DEBUG_ALGORITHM;
+  if ( is_debug( mask ) ) {
+    //
+    // Only algorithm debugging indents, so don't indent if it's off.
+    //
+    print_trace_record(
+      cerr, r, is_debug( DEBUG_ALGORITHM ) ? debug_indent_ : 0,
+      [this]( state::id id ) {
+        return id == NO_STATE_ID_ ? root_.name() : state_[ id ]->name();
+      },
+      e != nullptr ? e->name() : "",
+      [this]( transition::id id ) { return transition_[ id ].from_id_; }
+    );
+  }
+#endif /* CHSM_NO_DEBUG */
+#if defined CHSM_NO_DEBUG && defined CHSM_NO_TRACE
+  (void)r;                              // never called: see is_tracing()
+#endif
+}
+
+#ifndef CHSM_NO_METRICS
+void machine::metrics( metrics_snapshot &s ) const {
+  s.micro_steps_ = micro_steps_.get();
+  s.micro_step_events_ = micro_step_events_.get();
+  s.max_micro_step_events_ = max_micro_step_events_.get();
+
+  s.events_.clear();
+  for ( event const *e = events_; e != nullptr; e = e->next_event_ ) {
+    s.events_.push_back( metrics_snapshot::event_metrics{
+      e, e->broadcasts_.get(), e->rejected_.get(), e->cancelled_.get()
+    } );
+  } // for
+
+  s.states_.clear();
+  for ( auto const &state : *this ) {
+    s.states_.push_back( metrics_snapshot::state_metrics{
+      state.enters_.get(), state.exits_.get()
+    } );
+  } // for
+
+  s.transitions_.resize( transitions_in_machine_ );
+  for ( unsigned i = 0; i < transitions_in_machine_; ++i )
+    s.transitions_[i] = transitions_taken_[i].get();
+}
+
+machine::metrics_snapshot machine::metrics() const {
+  metrics_snapshot s;
+  metrics( s );
+  return s;
+}
+
+void machine::record_latency( bool on ) {
+  event::machine_lock const lock{ *this };
+  assert( !in_progress_ );
+  record_latency_ = on;
+}
+
+uint64_t machine::read_clock_ns() {
+  return static_cast<uint64_t>( clock::read().count() );
+}
+#endif /* CHSM_NO_METRICS */
+
+void machine::print_trace( ostream &o, trace_record const &r,
+                           trace_symbols const &s ) {
+  print_trace_record(
+    o, r, r.indent_,
+    [&s]( state::id id ) {
+      return id == NO_STATE_ID_ ? s.root_.c_str() : s.states_[ id ].c_str();
+    },
+    r.event_ != -1 ? s.events_[ r.event_ ].c_str() : "",
+    [&s]( transition::id id ) { return s.from_[ id ]; }
+  );
+}
+
+void machine::record_trace( size_t capacity ) {
+  event::machine_lock const lock{ *this };
+  delete[] trace_buf_;
+  trace_buf_ = nullptr;
+  trace_mask_ = 0;
+  trace_head_.store( 0, memory_order_relaxed );
+#ifdef CHSM_NO_TRACE
+  (void)capacity;
+#else
+  if ( capacity > 0 ) {
+    size_t n = 1;
+    while ( n < capacity )
+      n <<= 1;
+    trace_buf_ = new trace_slot[ n ]();
+    trace_mask_ = n - 1;
+  }
+#endif /* CHSM_NO_TRACE */
+}
+
+machine::trace_symbols machine::symbols() const {
+  trace_symbols s;
+  s.root_ = root_.name();
+  for ( state::id id = 0; state_[ id ] != nullptr; ++id )
+    s.states_.push_back( state_[ id ]->name() );
+  if ( events_ != nullptr ) {
+    //
+    // The list of events is newest first, so the first has the highest ID.
+    //
+    s.events_.resize( static_cast<size_t>( events_->id_ ) + 1 );
+    for ( event const *e = events_; e != nullptr; e = e->next_event_ )
+      s.events_[ static_cast<size_t>( e->id_ ) ] = e->name();
+  }
+  for ( unsigned i = 0; i < transitions_in_machine_; ++i )
+    s.from_.push_back( transition_[ i ].from_id_ );
+  return s;
+}
+
+void machine::set_lock_policy( lock_policy p ) {
+  assert( !in_progress_ );
+  assert( executor_of() == nullptr );
+  mutex_.set_policy( p );
+}
+
+vector<machine::trace_record> machine::trace_records() const {
+  vector<trace_record> records;
+  if ( trace_buf_ == nullptr )
+    return records;
+  uint64_t const head = trace_head_.load( memory_order_acquire );
+  uint64_t const size = trace_mask_ + 1;
+  uint64_t n = head > size ? head - size : 0;
+  records.reserve( head - n );
+  for ( ; n < head; ++n ) {
+    trace_slot const &slot = trace_buf_[ n & trace_mask_ ];
+    uint64_t const seq = slot.seq_.load( memory_order_acquire );
+    if ( seq != 2 * n + 2 )             // still being written or overwritten
+      continue;
+    uint64_t words[ sizeof slot.words_ / sizeof( uint64_t ) ];
+    for ( size_t i = 0; i < sizeof words / sizeof words[0]; ++i )
+      words[i] = slot.words_[i].load( memory_order_relaxed );
+    //
+    // This fence pairs with the one in emit_trace(): if any word read was
+    // written by a later record, the sequence number has since changed.
+    //
+    atomic_thread_fence( memory_order_acquire );
+    if ( slot.seq_.load( memory_order_relaxed ) != seq )
+      continue;
+    trace_record r;
+    ::memcpy( &r, words, sizeof r );
+    records.push_back( r );
+  } // for
+  return records;
 }
 
 bool machine::enter( event const &trigger ) {
-  // out-of-line since it's virtual
-  return root_.enter( trigger );
+  bool const entered = root_.enter( trigger );
+  event::machine_lock const lock{ *this };
+  publish_config();
+  return entered;
 }
 
 bool machine::exit( event const &trigger ) {
-  // out-of-line since it's virtual
-  return root_.exit( trigger );
+  bool const exited = root_.exit( trigger );
+  event::machine_lock const lock{ *this };
+  publish_config();
+  return exited;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void machine_mutex::spin_lock_slow() {
+  while ( !spin_try_lock() )
+    this_thread::yield();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,158 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/scheduler.cpp -- Run-Time library implementation
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#define CHSM_NO_ALIAS_NS
+#include "chsm.h"
+
+// standard
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace CHSM_NS {
+
+/**
+ * The %scheduler, if any, whose worker thread the current thread is.
+ */
+static thread_local scheduler const *tl_scheduler;
+
+/**
+ * The index of the worker that the current thread is (if tl_scheduler isn't
+ * null).
+ */
+static thread_local unsigned tl_worker;
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * A %worker is a thread and its run queue.  The run queue is guarded by its
+ * own mutex that's only ever contended by thieves, so it's held only very
+ * briefly.
+ */
+struct scheduler::worker {
+  mutex           mutex_;               ///< Guards run_queue_.
+  deque<machine*> run_queue_;           ///< Machines to run.
+  thread          thread_;              ///< The worker's thread.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+scheduler::scheduler( unsigned workers ) :
+  n_workers_{ workers > 0 ? workers : thread::hardware_concurrency() },
+  next_worker_{ 0 },
+  pending_{ 0 },
+  sleepers_{ 0 },
+  stopping_{ false }
+{
+  if ( n_workers_ == 0 )                // hardware_concurrency() unknown
+    n_workers_ = 1;
+  worker_ = new worker[ n_workers_ ];
+  for ( unsigned i = 0; i < n_workers_; ++i )
+    worker_[i].thread_ = thread{ &scheduler::main_loop, this, i };
+}
+
+scheduler::~scheduler() {
+  {
+    lock_guard<mutex> const lock{ idle_mutex_ };
+    stopping_ = true;
+  }
+  idle_cv_.notify_all();
+  for ( unsigned i = 0; i < n_workers_; ++i )
+    worker_[i].thread_.join();
+  delete[] worker_;
+}
+
+void scheduler::execute( machine &m ) {
+  unsigned const i = tl_scheduler == this ?
+    tl_worker : next_worker_.fetch_add( 1, memory_order_relaxed ) % n_workers_;
+  {
+    lock_guard<mutex> const lock{ worker_[i].mutex_ };
+    worker_[i].run_queue_.push_back( &m );
+  }
+  //
+  // Both pending_ and sleepers_ are sequentially consistent so that either we
+  // see a sleeper or the sleeper sees the new work (see main_loop()).
+  //
+  ++pending_;
+  if ( sleepers_.load() > 0 ) {
+    lock_guard<mutex> const lock{ idle_mutex_ };
+    idle_cv_.notify_one();
+  }
+}
+
+void scheduler::main_loop( unsigned i ) {
+  tl_scheduler = this;
+  tl_worker = i;
+
+  for (;;) {
+    if ( machine *const m = next_machine( i ) ) {
+      m->run_posted();
+      continue;
+    }
+
+    unique_lock<mutex> lock{ idle_mutex_ };
+    ++sleepers_;
+    idle_cv_.wait( lock, [this]() { return pending_.load() > 0 || stopping_; } );
+    --sleepers_;
+    if ( pending_.load() == 0 )         // must be stopping
+      return;
+  } // for
+}
+
+machine* scheduler::next_machine( unsigned i ) {
+  machine *m = nullptr;
+  {
+    //
+    // Take from the back of our own run queue: it's the machine most recently
+    // queued and so the most likely to still be in our cache.
+    //
+    worker &w = worker_[i];
+    lock_guard<mutex> const lock{ w.mutex_ };
+    if ( !w.run_queue_.empty() ) {
+      m = w.run_queue_.back();
+      w.run_queue_.pop_back();
+    }
+  }
+
+  //
+  // Otherwise, steal from the front of some other worker's run queue, starting
+  // with our neighbor so that thieves tend not to contend with one another.
+  //
+  for ( unsigned j = 1; m == nullptr && j < n_workers_; ++j ) {
+    worker &victim = worker_[ (i + j) % n_workers_ ];
+    lock_guard<mutex> const lock{ victim.mutex_ };
+    if ( !victim.run_queue_.empty() ) {
+      m = victim.run_queue_.front();
+      victim.run_queue_.pop_front();
+    }
+  } // for
+
+  if ( m != nullptr )
+    --pending_;
+  return m;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+/* vim:set et sw=2 ts=2: */
@@ -26,13 +26,17 @@ namespace CHSM_NS {
 
 ///////////////////////////////////////////////////////////////////////////////
 
-bool set::enter( event const &trigger, state* ) {
+bool set::enter( event const &trigger, state *from_child ) {
   if ( !state::enter( trigger ) )
     return false;
 
-  // enter all of our children
+  //
+  // Enter all of our children except the one (if any) being entered directly:
+  // it will take care of entering itself (and not its default child).
+  //
   for ( auto &child : *this )
-    child.enter( trigger );
+    if ( &child != from_child )
+      child.enter( trigger );
 
   return true;
 }
@@ -0,0 +1,86 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/simulator.cpp -- Run-Time library implementation
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#define CHSM_NO_ALIAS_NS
+#include "chsm.h"
+#include "timer_wheel.h"
+
+// standard
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+using namespace std;
+
+namespace CHSM_NS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+simulator::simulator() :
+  now_{ 0 },
+  prev_{ clock::install( this ) }
+{
+}
+
+simulator::~simulator() {
+  clock::install( prev_ );
+}
+
+void simulator::execute( machine &m ) {
+  run_queue_.push_back( &m );
+}
+
+chrono::nanoseconds simulator::now() const {
+  return now_;
+}
+
+void simulator::run_machines() {
+  while ( !run_queue_.empty() ) {
+    machine *const m = run_queue_.front();
+    run_queue_.pop_front();
+    m->run_posted();
+  } // while
+}
+
+size_t simulator::run_until( chrono::nanoseconds t ) {
+  timer_wheel &wheel = timer_wheel::instance();
+  size_t expired = 0;
+  for (;;) {
+    run_machines();
+    chrono::nanoseconds const next = wheel.next_time();
+    if ( next == chrono::nanoseconds::max() || next > t )
+      break;
+    //
+    // Nothing can happen before the next tick of the timer wheel at which
+    // there's something to do, so jump straight to it.
+    //
+    now_ = max( now_, next );
+    expired += wheel.expire();
+  } // for
+  if ( t != chrono::nanoseconds::max() )
+    now_ = max( now_, t );
+  return expired;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+/* vim:set et sw=2 ts=2: */
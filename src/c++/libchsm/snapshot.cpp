@@ -0,0 +1,507 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/snapshot.cpp -- Run-Time library implementation
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#define CHSM_NO_ALIAS_NS
+#include "chsm.h"
+#include "inbox.h"
+
+// standard
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace CHSM_NS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// A snapshot is:
+//
+//    magic           "CHSM"
+//    version         1 byte
+//    states          varint: number of states (excluding the root)
+//    events          varint: number of events
+//    transitions     varint: number of transitions
+//    root            1 byte: 1 if the root cluster is active; 0 if not
+//    active          (states + 7) / 8 bytes: bitset of active states by ID
+//    histories       varint: number of history records, then for each:
+//      cluster       varint: ID of an inactive cluster having a history
+//      child         varint: ID of its last active child
+//    pending         varint: number of pending events, then for each:
+//      event         varint: index of the event
+//
+// where a varint is an unsigned integer, 7 bits per byte, least significant
+// byte first, and the high bit set on all bytes but the last.
+//
+
+static char const           SNAPSHOT_MAGIC[] = { 'C', 'H', 'S', 'M' };
+static uint8_t const        SNAPSHOT_VERSION = 1;
+
+/**
+ * Appends an unsigned integer as a varint.
+ *
+ * @param buf The buffer to append to.
+ * @param n The integer to append.
+ */
+static void put_varint( machine::snapshot_data &buf, size_t n ) {
+  for ( ; n >= 0x80; n >>= 7 )
+    buf.push_back( static_cast<uint8_t>( n | 0x80 ) );
+  buf.push_back( static_cast<uint8_t>( n ) );
+}
+
+/**
+ * A %snapshot_reader reads the parts of a snapshot.  Once it has failed, all
+ * further reads fail too.
+ */
+class snapshot_reader {
+public:
+  snapshot_reader( void const *data, size_t size ) :
+    p_{ static_cast<uint8_t const*>( data ) },
+    end_{ p_ + size },
+    ok_{ data != nullptr }
+  {
+  }
+
+  /**
+   * Gets whether all reads so far have succeeded.
+   *
+   * @return Returns `true` only if so.
+   */
+  bool ok() const {
+    return ok_;
+  }
+
+  /**
+   * Gets whether all reads so far have succeeded and there is nothing left
+   * to read.
+   *
+   * @return Returns `true` only if so.
+   */
+  bool done() const {
+    return ok_ && p_ == end_;
+  }
+
+  /**
+   * Reads raw bytes.
+   *
+   * @param n The number of bytes to read.
+   * @return Returns a pointer to them or null if there are too few left.
+   */
+  uint8_t const* bytes( size_t n ) {
+    if ( !ok_ || static_cast<size_t>( end_ - p_ ) < n )
+      return ok_ = false, nullptr;
+    uint8_t const *const b = p_;
+    p_ += n;
+    return b;
+  }
+
+  /**
+   * Reads a varint.
+   *
+   * @param max The maximum value allowed.
+   * @return Returns said integer or 0 upon failure.
+   */
+  size_t varint( size_t max ) {
+    size_t n = 0;
+    for ( unsigned shift = 0; ok_; shift += 7 ) {
+      if ( p_ == end_ || shift >= 8 * sizeof n )
+        break;
+      uint8_t const b = *p_++;
+      n |= static_cast<size_t>( b & 0x7F ) << shift;
+      if ( (b & 0x80) == 0 ) {
+        if ( n > max )
+          break;
+        return n;
+      }
+    } // for
+    ok_ = false;
+    return 0;
+  }
+
+private:
+  uint8_t const        *p_;
+  uint8_t const *const  end_;
+  bool                  ok_;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool machine::snapshot( snapshot_data &buf ) const {
+  event::machine_lock const lock{ *this };
+  if ( in_progress_ )
+    return false;
+
+  size_t n_states = 0;
+  while ( state_[ n_states ] != nullptr )
+    ++n_states;
+  vector<event const*> events;
+  for ( event const *e = events_; e != nullptr; e = e->next_event_ )
+    events.push_back( e );
+
+  buf.assign( SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + sizeof SNAPSHOT_MAGIC );
+  buf.push_back( SNAPSHOT_VERSION );
+  put_varint( buf, n_states );
+  put_varint( buf, events.size() );
+  put_varint( buf, transitions_in_machine_ );
+  buf.push_back( root_.active() ? 1 : 0 );
+
+  size_t const active_pos = buf.size();
+  buf.resize( active_pos + (n_states + 7) / 8 );
+  for ( size_t id = 0; id < n_states; ++id ) {
+    if ( state_[ id ]->active() )
+      buf[ active_pos + id / 8 ] |= static_cast<uint8_t>( 1u << id % 8 );
+  } // for
+
+  //
+  // A cluster's history matters only while it's inactive since, while it's
+  // active, its last active child is its active child.
+  //
+  vector<pair<size_t,size_t>> histories;
+  for ( size_t id = 0; id < n_states; ++id ) {
+    auto const c = dynamic_cast<cluster const*>( state_[ id ] );
+    if ( c != nullptr && c->desc_.history_ && !c->active() &&
+         c->last_child_ != nullptr ) {
+      histories.emplace_back( id, c->last_child_->desc_.id_ );
+    }
+  } // for
+  put_varint( buf, histories.size() );
+  for ( auto const &h : histories ) {
+    put_varint( buf, h.first );
+    put_varint( buf, h.second );
+  } // for
+
+  vector<size_t> pending;
+  if ( inbox *const ib = inbox_.load( memory_order_acquire ) ) {
+    for ( size_t i = 0; inbox_entry const *const entry = ib->peek( i ); ++i ) {
+      event *const e = entry->event_;
+      if ( e == nullptr || dynamic_cast<timeout_event*>( e ) != nullptr )
+        continue;
+      if ( !e->post_again( true ) )
+        return false;
+      size_t index = 0;
+      while ( events[ index ] != e )
+        ++index;
+      pending.push_back( index );
+    } // for
+  }
+  put_varint( buf, pending.size() );
+  for ( size_t index : pending )
+    put_varint( buf, index );
+
+  return true;
+}
+
+bool machine::restore( void const *data, size_t size ) {
+  vector<event*> events;
+  for ( event *e = events_; e != nullptr; e = e->next_event_ )
+    events.push_back( e );
+  vector<size_t> pending;
+
+  {
+    event::machine_lock const lock{ *this };
+    if ( in_progress_ )
+      return false;
+    //
+    // Events already posted were posted relative to the current states and
+    // would be broadcast after the restored ones, so refuse to restore.
+    //
+    if ( inbox *const ib = inbox_.load( memory_order_acquire ) )
+      if ( !ib->empty() )
+        return false;
+
+    size_t n_states = 0;
+    while ( state_[ n_states ] != nullptr )
+      ++n_states;
+
+    //
+    // Read and check the entire snapshot before changing anything.
+    //
+    snapshot_reader r{ data, size };
+    uint8_t const *const magic = r.bytes( sizeof SNAPSHOT_MAGIC );
+    if ( magic == nullptr ||
+         ::memcmp( magic, SNAPSHOT_MAGIC, sizeof SNAPSHOT_MAGIC ) != 0 ) {
+      return false;
+    }
+    uint8_t const *const version = r.bytes( 1 );
+    if ( version == nullptr || *version != SNAPSHOT_VERSION )
+      return false;
+    if ( r.varint( n_states ) != n_states ||
+         r.varint( events.size() ) != events.size() ||
+         r.varint( transitions_in_machine_ ) != transitions_in_machine_ ) {
+      return false;
+    }
+    uint8_t const *const root = r.bytes( 1 );
+    uint8_t const *const active = r.bytes( (n_states + 7) / 8 );
+    if ( root == nullptr || *root > 1 || active == nullptr )
+      return false;
+    bool const root_active = *root != 0;
+    auto const is_active = [&]( state const *s ) {
+      state::id const id = s->desc_.id_;
+      return s == &root_ ? root_active : (active[ id / 8 ] & 1u << id % 8) != 0;
+    };
+
+    vector<pair<cluster*,state*>> histories( r.varint( n_states ) );
+    for ( auto &h : histories ) {
+      size_t const cid = r.varint( n_states - 1 );
+      size_t const sid = r.varint( n_states - 1 );
+      if ( !r.ok() )
+        return false;
+      h.first = dynamic_cast<cluster*>( state_[ cid ] );
+      h.second = state_[ sid ];
+      if ( h.first == nullptr || !h.first->desc_.history_ ||
+           is_active( h.first ) || h.second->parent_of() != h.first ) {
+        return false;
+      }
+    } // for
+
+    pending.resize( r.varint( CHSM_INBOX_CAPACITY ) );
+    for ( size_t &index : pending ) {
+      index = r.varint( events.size() );
+      if ( index == events.size() )
+        return false;
+    } // for
+    if ( !r.done() )
+      return false;
+
+    //
+    // Check that the active states are a legal configuration: each active
+    // state's parent is active; and each active cluster has exactly one
+    // active child whereas each active set has all its children active.
+    //
+    auto const is_legal = [&]( parent const &p ) {
+      if ( !is_active( &p ) )
+        return true;
+      unsigned n_active = 0, n_children = 0;
+      for ( auto const &child : p ) {
+        ++n_children;
+        if ( is_active( &child ) )
+          ++n_active;
+      } // for
+      return dynamic_cast<cluster const*>( &p ) != nullptr ?
+        n_active == 1 : n_active == n_children;
+    };
+    if ( !is_legal( root_ ) )
+      return false;
+    for ( size_t id = 0; id < n_states; ++id ) {
+      state const *const s = state_[ id ];
+      if ( is_active( s ) && !is_active( s->parent_of() ) )
+        return false;
+      if ( auto const p = dynamic_cast<parent const*>( s ) )
+        if ( !is_legal( *p ) )
+          return false;
+    } // for
+    for ( size_t index : pending )
+      if ( !events[ index ]->post_again( true ) )
+        return false;
+
+    //
+    // Now make the states in the snapshot active and all others inactive
+    // without performing any enter or exit actions.
+    //
+    auto const reset = [&]( state &s ) {
+      for ( timeout_event *t = s.timeouts_; t != nullptr; t = t->next_timeout_ )
+        t->cancel();
+      bool const now_active = is_active( &s );
+      s.state_ = now_active ? state::STATE_ACTIVE : state::STATE_INACTIVE;
+      set_active( s.desc_.id_, now_active );
+      if ( auto const c = dynamic_cast<cluster*>( &s ) ) {
+        c->active_child_ = nullptr;
+        for ( auto &child : *c ) {
+          if ( is_active( &child ) ) {
+            c->active_child_ = &child;
+            break;
+          }
+        } // for
+        c->last_child_ = c->active_child_;
+      }
+      if ( now_active ) {
+        for ( timeout_event *t = s.timeouts_; t; t = t->next_timeout_ )
+          t->arm();
+      }
+    };
+    reset( root_ );
+    for ( size_t id = 0; id < n_states; ++id )
+      reset( *state_[ id ] );
+    for ( auto const &h : histories )
+      h.first->last_child_ = h.second;
+    publish_config();
+  }
+
+  //
+  // Post the pending events again only after having unlocked since, if we
+  // aren't bound to an executor, posting broadcasts them right away.
+  //
+  for ( size_t index : pending )
+    events[ index ]->post_again( false );
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// A saved trace is:
+//
+//    magic           "CHTR"
+//    version         1 byte
+//    root            string: name of the root cluster
+//    states          varint: number of states, then for each:
+//      name          string: its name
+//    events          varint: number of events, then for each:
+//      name          string: its name
+//    transitions     varint: number of transitions, then for each:
+//      from          varint: ID of its "from" state + 1
+//    records         varint: number of records, then for each:
+//      time          8 bytes: clock nanoseconds, least significant byte first
+//      kind          1 byte: trace_kind
+//      indent        1 byte: debugging indentation
+//      transition    varint: transition ID, count, or flag + 1
+//      state         varint: state ID + 1
+//      event         varint: event ID + 1
+//
+// where a string is a varint length followed by that many bytes.  IDs are
+// offset by 1 so that -1 (none) is 0.
+//
+
+static char const           TRACE_MAGIC[] = { 'C', 'H', 'T', 'R' };
+static uint8_t const        TRACE_VERSION = 1;
+
+/**
+ * Appends a string as a varint length followed by its bytes.
+ *
+ * @param buf The buffer to append to.
+ * @param s The string to append.
+ */
+static void put_string( vector<uint8_t> &buf, string const &s ) {
+  put_varint( buf, s.size() );
+  buf.insert( buf.end(), s.begin(), s.end() );
+}
+
+void machine::save_trace( vector<uint8_t> &buf ) const {
+  trace_symbols const s{ symbols() };
+  vector<trace_record> const records{ trace_records() };
+
+  buf.assign( TRACE_MAGIC, TRACE_MAGIC + sizeof TRACE_MAGIC );
+  buf.push_back( TRACE_VERSION );
+  put_string( buf, s.root_ );
+  put_varint( buf, s.states_.size() );
+  for ( auto const &name : s.states_ )
+    put_string( buf, name );
+  put_varint( buf, s.events_.size() );
+  for ( auto const &name : s.events_ )
+    put_string( buf, name );
+  put_varint( buf, s.from_.size() );
+  for ( state::id from_id : s.from_ )
+    put_varint( buf, static_cast<size_t>( from_id + 1 ) );
+
+  put_varint( buf, records.size() );
+  for ( auto const &r : records ) {
+    for ( unsigned i = 0; i < 8; ++i )
+      buf.push_back( static_cast<uint8_t>( r.time_ >> 8 * i ) );
+    buf.push_back( r.kind_ );
+    buf.push_back( r.indent_ );
+    put_varint( buf, static_cast<size_t>( r.transition_ + 1 ) );
+    put_varint( buf, static_cast<size_t>( r.state_ + 1 ) );
+    put_varint( buf, static_cast<size_t>( r.event_ + 1 ) );
+  } // for
+}
+
+bool machine::load_trace( void const *data, size_t size, trace_symbols &s,
+                          vector<trace_record> &records ) {
+  snapshot_reader r{ data, size };
+  auto const get_string = [&r, size]( string &str ) {
+    size_t const n = r.varint( size );
+    if ( uint8_t const *const b = r.bytes( n ) )
+      str.assign( reinterpret_cast<char const*>( b ), n );
+  };
+
+  uint8_t const *const magic = r.bytes( sizeof TRACE_MAGIC );
+  if ( magic == nullptr ||
+       ::memcmp( magic, TRACE_MAGIC, sizeof TRACE_MAGIC ) != 0 ) {
+    return false;
+  }
+  uint8_t const *const version = r.bytes( 1 );
+  if ( version == nullptr || *version != TRACE_VERSION )
+    return false;
+
+  get_string( s.root_ );
+  s.states_.resize( r.varint( size ) );
+  for ( auto &name : s.states_ )
+    get_string( name );
+  s.events_.resize( r.varint( size ) );
+  for ( auto &name : s.events_ )
+    get_string( name );
+  size_t const n_states = s.states_.size();
+  s.from_.resize( r.varint( size ) );
+  for ( state::id &from_id : s.from_ )
+    from_id = static_cast<state::id>( r.varint( n_states ) ) - 1;
+  if ( !r.ok() )
+    return false;
+
+  records.resize( r.varint( size ) );
+  for ( auto &rec : records ) {
+    uint8_t const *const time = r.bytes( 8 );
+    uint8_t const *const kind_indent = r.bytes( 2 );
+    if ( time == nullptr || kind_indent == nullptr ||
+         kind_indent[0] > TRACE_PHASE_III ) {
+      return false;
+    }
+    rec.time_ = 0;
+    for ( unsigned i = 0; i < 8; ++i )
+      rec.time_ |= static_cast<uint64_t>( time[i] ) << 8 * i;
+    rec.kind_ = static_cast<trace_kind>( kind_indent[0] );
+    rec.indent_ = kind_indent[1];
+    rec.transition_ = static_cast<transition::id>(
+      r.varint( static_cast<size_t>( INT_MAX ) )
+    ) - 1;
+    rec.state_ = static_cast<state::id>( r.varint( n_states ) ) - 1;
+    rec.event_ = static_cast<event::id>( r.varint( s.events_.size() ) ) - 1;
+    if ( !r.ok() )
+      return false;
+    //
+    // Check that the IDs the record refers to are ones print_trace() will
+    // look up.
+    //
+    switch ( rec.kind_ ) {
+      case TRACE_FOUND:
+      case TRACE_PERFORMING:
+        if ( rec.transition_ < 0 ||
+             static_cast<size_t>( rec.transition_ ) >= s.from_.size() ) {
+          return false;
+        }
+        break;
+      default:
+        break;
+    } // switch
+  } // for
+  return r.done();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+/* vim:set et sw=2 ts=2: */
@@ -31,11 +31,9 @@ namespace CHSM_NS {
 
 state::state( CHSM_STATE_ARGS ) :
   machine_{ chsm_machine_ },
-  name_{ chsm_name_ },
-  parent_{ chsm_parent_ },
+  desc_{ chsm_descriptor_ },
   state_{ STATE_INACTIVE },
-  enter_action_{ chsm_enter_action_ }, exit_action_{ chsm_exit_action_ },
-  enter_event_{ chsm_enter_event_ }, exit_event_{ chsm_exit_event_ }
+  timeouts_{ nullptr }
 {
   // do nothing else
 }
@@ -80,27 +78,34 @@ bool state::enter( event const &trigger, state* ) {
     }
   }
 
-  if ( machine_.is_debug( machine::DEBUG_ENTER_EXIT ) )
-    machine_.dout() << "entering: " << name() ENDL;
+  if ( machine_.is_tracing() )
+    machine_.emit_trace( machine::TRACE_ENTER, nullptr, -1, desc_.id_ );
 
   state_ = STATE_ACTIVE;
+  machine_.set_active( desc_.id_, true );
+#ifndef CHSM_NO_METRICS
+  ++enters_;
+#endif /* CHSM_NO_METRICS */
+
+  for ( timeout_event *t = timeouts_; t != nullptr; t = t->next_timeout_ )
+    t->arm();
 
   //
   // For this state, broadcast entered(*this), but only if there are any
   // transitions on it.  The value for the enter_event_ pointer is determined
   // by the CHSM-to-C++ compiler.
   //
-  if ( enter_event_ != nullptr )
-    enter_event_->lock_broadcast();
+  if ( desc_.enter_event_ != nullptr )
+    (machine_.*desc_.enter_event_).lock_broadcast();
 
   //
   // Perform the enter action resulting from an "upon enter" statement, if any.
   // The value for the enter_action_ pointer is determined by the CHSM-to-C++
   // compiler.
   //
-  if ( enter_action_ != nullptr ) {
+  if ( desc_.enter_action_ != nullptr ) {
     try {
-      (machine_.*enter_action_)( *this, trigger );
+      (machine_.*desc_.enter_action_)( *this, trigger );
     }
     catch ( ... ) {
       //
@@ -117,26 +122,33 @@ bool state::exit( event const &trigger, state *to ) {
     return false;
 
   state_ = STATE_INACTIVE;
+  machine_.set_active( desc_.id_, false );
+#ifndef CHSM_NO_METRICS
+  ++exits_;
+#endif /* CHSM_NO_METRICS */
+
+  for ( timeout_event *t = timeouts_; t != nullptr; t = t->next_timeout_ )
+    t->cancel();
 
-  if ( machine_.is_debug( machine::DEBUG_ENTER_EXIT ) )
-    machine_.dout() << "exiting : " << name() ENDL;
+  if ( machine_.is_tracing() )
+    machine_.emit_trace( machine::TRACE_EXIT, nullptr, -1, desc_.id_ );
 
   //
   // For this state, broadcast exited(*this), but only if there are any
   // transitions on it.  The value for the exit_event_ pointer is determined by
   // the CHSM-to-C++ compiler.
   //
-  if ( exit_event_ != nullptr )
-    exit_event_->lock_broadcast();
+  if ( desc_.exit_event_ != nullptr )
+    (machine_.*desc_.exit_event_).lock_broadcast();
 
   //
   // Perform the exit action resulting from an "upon exit" statement, if any.
   // The value for the exit_action_ pointer is determined by the CHSM-to-C++
   // compiler.
   //
-  if ( exit_action_ != nullptr ) {
+  if ( desc_.exit_action_ != nullptr ) {
     try {
-      (machine_.*exit_action_)( *this, trigger );
+      (machine_.*desc_.exit_action_)( *this, trigger );
     }
     catch ( ... ) {
       //
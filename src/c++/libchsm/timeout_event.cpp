@@ -0,0 +1,79 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/timeout_event.cpp -- Run-Time library implementation
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+**
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+**
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#define CHSM_NO_ALIAS_NS
+#include "chsm.h"
+#include "timer_wheel.h"
+
+// standard
+#include <chrono>
+
+using namespace std;
+
+namespace CHSM_NS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+timeout_event::timeout_event( CHSM_EVENT_ARGS, state &chsm_state_,
+                              delay chsm_delay_ ) :
+  event{ CHSM_EVENT_INIT },
+  state_{ chsm_state_ },
+  delay_{ chsm_delay_ },
+  next_timeout_{ chsm_state_.timeouts_ },
+  wheel_next_{ nullptr },
+  wheel_pprev_{ nullptr },
+  expiry_{ 0 },
+  generation_{ 0 }
+{
+  chsm_state_.timeouts_ = this;
+}
+
+timeout_event::~timeout_event() {
+  timer_wheel::instance().remove( this );
+}
+
+void timeout_event::arm() {
+  chrono::nanoseconds d;
+  try {
+    d = (machine_.*delay_)();
+  }
+  catch ( ... ) {
+    //
+    // Consider an exception thrown by a delay to mean "never."
+    //
+    return;
+  }
+  timer_wheel::instance().arm( this, d );
+}
+
+void timeout_event::cancel() {
+  timer_wheel::instance().cancel( this );
+}
+
+bool timeout_event::param_block::precondition() const {
+  return chsm_generation_ ==
+    static_cast<timeout_event const&>( chsm_event_ ).generation_;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+/* vim:set et sw=2 ts=2: */
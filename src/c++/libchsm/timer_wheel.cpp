@@ -0,0 +1,355 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/timer_wheel.cpp -- Run-Time library implementation
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+**
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+**
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// local
+#define CHSM_NO_ALIAS_NS
+#include "chsm.h"
+#include "timer_wheel.h"
+
+// standard
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace CHSM_NS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+timer_wheel::timer_wheel() :
+  slot_{ },
+  due_{ nullptr },
+  now_{ 0 },
+  wake_{ NEVER },
+  armed_{ 0 },
+  epoch_{ clock::read() },
+  real_time_{ clock::installed() == nullptr },
+  posting_{ nullptr },
+  running_{ nullptr }
+{
+}
+
+timer_wheel& timer_wheel::instance() {
+  static timer_wheel *const wheel = new timer_wheel;
+  return *wheel;
+}
+
+void timer_wheel::advance() {
+  ++now_;
+  if ( (now_ & SLOT_MASK) == 0 ) {
+    //
+    // We've come around to the start of level 0 again, so cascade the next
+    // slot of level 1 into it; if that's come around too, cascade the next
+    // slot of level 2 into level 1, and so on.
+    //
+    for ( unsigned level = 1; level < LEVELS; ++level ) {
+      unsigned const slot = (now_ >> (level * SLOT_BITS)) & SLOT_MASK;
+      cascade( level, slot );
+      if ( slot != 0 )
+        break;
+    } // for
+  }
+
+  timeout_event **const head = &slot_[0][ now_ & SLOT_MASK ];
+  while ( timeout_event *const t = *head ) {
+    unlink( t );
+    link( &due_, t );
+  } // while
+}
+
+void timer_wheel::advance_to( uint64_t tick ) {
+  while ( now_ < tick ) {
+    uint64_t const next = next_tick();
+    if ( next > tick ) {
+      //
+      // There's nothing to do for the remaining ticks: skip them.
+      //
+      now_ = tick;
+      break;
+    }
+    //
+    // Likewise for the ticks before the next one.
+    //
+    now_ = next - 1;
+    advance();
+  } // while
+}
+
+void timer_wheel::arm( timeout_event *t, chrono::nanoseconds delay ) {
+  lock_guard<mutex> const lock{ mutex_ };
+  if ( real_time_ && !thread_.joinable() ) {
+    thread_ = thread{ &timer_wheel::main_loop, this };
+    runner_ = thread{ &timer_wheel::run_loop, this };
+  }
+
+  uint64_t const tick = tick_of( clock::read() );
+  if ( t->wheel_pprev_ != nullptr )
+    unlink( t );
+  else if ( armed_++ == 0 ) {
+    //
+    // The wheel is empty, so there's nothing to process for the ticks since
+    // the last one that was: skip them.
+    //
+    now_ = max( now_, tick );
+  }
+
+  uint64_t ticks = 0;
+  if ( delay.count() > 0 ) {
+    //
+    // Round up so a timeout never expires early.
+    //
+    ticks = chrono::ceil<tick_duration>( delay ).count();
+  }
+  ticks = min( tick + ticks, now_ + MAX_TICKS ) - now_;
+  t->expiry_ = now_ + max( ticks, uint64_t{ 1 } );
+  ++t->generation_;
+  link( t );
+
+  if ( real_time_ && t->expiry_ < wake_ )
+    cv_.notify_one();
+}
+
+void timer_wheel::cancel( timeout_event *t ) {
+  lock_guard<mutex> const lock{ mutex_ };
+  disarm( t );
+}
+
+void timer_wheel::cascade( unsigned level, unsigned slot ) {
+  timeout_event *t = slot_[ level ][ slot ];
+  slot_[ level ][ slot ] = nullptr;
+  while ( t != nullptr ) {
+    timeout_event *const next = t->wheel_next_;
+    link( t );
+    t = next;
+  } // while
+}
+
+void timer_wheel::disarm( timeout_event *t ) {
+  ++t->generation_;
+  if ( t->wheel_pprev_ != nullptr ) {
+    unlink( t );
+    --armed_;
+  }
+}
+
+void timer_wheel::link( timeout_event *t ) {
+  uint64_t const delta = t->expiry_ - now_;
+  unsigned level = 0;
+  while ( level < LEVELS - 1 && delta >> ((level + 1) * SLOT_BITS) != 0 )
+    ++level;
+  unsigned const slot = (t->expiry_ >> (level * SLOT_BITS)) & SLOT_MASK;
+  link( &slot_[ level ][ slot ], t );
+}
+
+void timer_wheel::link( timeout_event **head, timeout_event *t ) {
+  if ( (t->wheel_next_ = *head) != nullptr )
+    t->wheel_next_->wheel_pprev_ = &t->wheel_next_;
+  *head = t;
+  t->wheel_pprev_ = head;
+}
+
+size_t timer_wheel::expire() {
+  unique_lock<mutex> lock{ mutex_ };
+
+  advance_to( tick_of( clock::read() ) );
+
+  size_t expired = 0;
+  while ( timeout_event *const t = due_ ) {
+    unlink( t );
+    --armed_;
+    uint64_t const generation = t->generation_;
+    machine &m = t->chsm();
+    //
+    // Don't hold the lock while posting since asking the machine's executor
+    // to run it may block on the executor's own mutex.  Meanwhile, remove()
+    // waits for posting_ to be reset so t can't be destroyed.
+    //
+    posting_ = t;
+    lock.unlock();
+    bool const posted = m.post_timeout( *t, generation );
+    bool const unbound = m.executor_of() == nullptr;
+    lock.lock();
+    posting_ = nullptr;
+    done_cv_.notify_all();
+
+    //
+    // If the machine has no executor, nobody will broadcast the timeout (or,
+    // if its inbox is full, make room) until the machine is next used, so it
+    // has to be run.  (If an executor is bound in the meantime, running it
+    // merely does nothing.)
+    //
+    if ( unbound ) {
+      auto const end = run_queue_.end();
+      if ( find( run_queue_.begin(), end, &m ) == end ) {
+        run_queue_.push_back( &m );
+        run_cv_.notify_one();
+      }
+    }
+
+    if ( posted ) {
+      ++expired;
+    }
+    else if ( t->generation_ == generation && t->wheel_pprev_ == nullptr ) {
+      //
+      // The machine's inbox is full.  Rather than waiting for room (perhaps
+      // for a thread that's waiting for us), try again at the next tick --
+      // unless t has been re-armed or cancelled in the meantime.
+      //
+      t->expiry_ = now_ + 1;
+      link( t );
+      ++armed_;
+    }
+  } // while
+
+  if ( !real_time_ )
+    run_queued( lock );
+  return expired;
+}
+
+void timer_wheel::main_loop() {
+  unique_lock<mutex> lock{ mutex_ };
+  for (;;) {
+    wake_ = armed_ == 0 || !real_time_ ? NEVER : next_tick();
+    if ( wake_ > tick_of( clock::read() ) ) {
+      if ( wake_ == NEVER )
+        cv_.wait( lock );
+      else {
+        tick_duration const wake_at( static_cast<int64_t>( wake_ ) );
+        chrono::steady_clock::time_point const when{
+          chrono::duration_cast<chrono::steady_clock::duration>(
+            epoch_ + wake_at
+          )
+        };
+        cv_.wait_until( lock, when );
+      }
+      continue;
+    }
+    wake_ = now_;
+    lock.unlock();
+    expire();
+    lock.lock();
+  } // for
+}
+
+void timer_wheel::run_loop() {
+  unique_lock<mutex> lock{ mutex_ };
+  for (;;) {
+    //
+    // While a clock other than real time is installed, whoever calls
+    // expire() runs the machines instead.
+    //
+    run_cv_.wait( lock, [this]() {
+      return real_time_ && !run_queue_.empty();
+    } );
+    run_queued( lock );
+  } // for
+}
+
+void timer_wheel::run_queued( unique_lock<mutex> &lock ) {
+  while ( !run_queue_.empty() ) {
+    machine *const m = running_ = run_queue_.front();
+    running_on_ = this_thread::get_id();
+    run_queue_.pop_front();
+    lock.unlock();
+    m->drain_inbox();
+    lock.lock();
+    running_ = nullptr;
+    done_cv_.notify_all();
+  } // while
+}
+
+chrono::nanoseconds timer_wheel::next_time() {
+  lock_guard<mutex> const lock{ mutex_ };
+  if ( armed_ == 0 )
+    return chrono::nanoseconds::max();
+  tick_duration const next( static_cast<int64_t>( next_tick() ) );
+  return epoch_ + next;
+}
+
+uint64_t timer_wheel::next_tick() const {
+  for ( unsigned level = 0; level < LEVELS; ++level ) {
+    unsigned const shift = level * SLOT_BITS;
+    uint64_t const rotation = now_ >> shift >> SLOT_BITS;
+    unsigned const cur = (now_ >> shift) & SLOT_MASK;
+    //
+    // The slots after the current one are reached in this rotation of the
+    // level: the first non-empty one is when there's next something to do.
+    //
+    for ( unsigned slot = cur + 1; slot < SLOTS; ++slot )
+      if ( slot_[ level ][ slot ] != nullptr )
+        return ((rotation << SLOT_BITS) | slot) << shift;
+    //
+    // The slots up to and including the current one are reached only in the
+    // next rotation of the level: the start of that is a tick at which
+    // there's something to do unless something sooner is in the next level.
+    // But the start of the next rotation is sooner than anything in the next
+    // level anyway.
+    //
+    for ( unsigned slot = 0; slot <= cur; ++slot )
+      if ( slot_[ level ][ slot ] != nullptr )
+        return (rotation + 1) << (shift + SLOT_BITS);
+  } // for
+  return NEVER;
+}
+
+void timer_wheel::remove( timeout_event *t ) {
+  unique_lock<mutex> lock{ mutex_ };
+  disarm( t );
+
+  //
+  // Our machine is being destroyed: make sure it won't be run and, if it's
+  // being run now, wait until it isn't -- unless it's being run by us, i.e.,
+  // one of its own actions is destroying it.
+  //
+  machine *const m = &t->chsm();
+  run_queue_.erase(
+    std::remove( run_queue_.begin(), run_queue_.end(), m ), run_queue_.end()
+  );
+  thread::id const self = this_thread::get_id();
+  done_cv_.wait( lock, [this,t,m,self]() {
+    return posting_ != t && (running_ != m || running_on_ == self);
+  } );
+}
+
+void timer_wheel::restart() {
+  lock_guard<mutex> const lock{ mutex_ };
+  assert( armed_ == 0 );
+  now_ = 0;
+  epoch_ = clock::read();
+  real_time_ = clock::installed() == nullptr;
+  cv_.notify_one();
+  run_cv_.notify_one();
+}
+
+void timer_wheel::unlink( timeout_event *t ) {
+  if ( (*t->wheel_pprev_ = t->wheel_next_) != nullptr )
+    t->wheel_next_->wheel_pprev_ = t->wheel_pprev_;
+  t->wheel_next_ = nullptr;
+  t->wheel_pprev_ = nullptr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,271 @@
+/*
+**      CHSM Language System
+**      src/c++/libchsm/timer_wheel.h
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+**
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+**
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef chsm_timer_wheel_H
+#define chsm_timer_wheel_H
+
+// local
+#include "chsm.h"
+
+// standard
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ratio>
+#include <thread>
+
+/**
+ * The number of microseconds per tick of the timer wheel.
+ */
+#ifndef CHSM_TIMER_TICK_US
+#define CHSM_TIMER_TICK_US        1000
+#endif /* CHSM_TIMER_TICK_US */
+
+namespace CHSM_NS {
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @internal
+ *
+ * A %timer_wheel is a hierarchical timing wheel (see Varghese & Lauck,
+ * "Hashed and Hierarchical Timing Wheels") for the timeout events of all
+ * machines.  It has 4 levels of 256 slots each: level 0 has a slot per tick;
+ * each slot of level \e n spans all of level \e n-1.  A slot is an intrusive,
+ * doubly-linked list of timeout events, so arming and cancelling are O(1).
+ * When a slot of level \e n is reached, its timeouts are "cascaded" down into
+ * the lower levels.
+ *
+ * The wheel has a thread that is started upon the first arming.  It sleeps
+ * until the next tick having a timeout in level 0 or a non-empty slot of a
+ * higher level to cascade, whichever is first.  While a clock other than real
+ * time is installed (see clock::install()), the thread doesn't expire
+ * timeouts: whoever installed it calls expire() instead.
+ *
+ * Expiring a timeout only posts it to its machine: no user code ever runs
+ * while expiring timeouts.  The machines that have no executor to broadcast
+ * their timeouts are instead run by a second thread of the wheel (or, while
+ * a clock other than real time is installed, by whoever calls expire()).
+ */
+class timer_wheel {
+public:
+  /**
+   * Gets the one and only %timer_wheel.  It's never destroyed so timeouts of
+   * machines having static storage duration can still be cancelled when
+   * destroyed.
+   *
+   * @return Returns said %timer_wheel.
+   */
+  static timer_wheel& instance();
+
+  /**
+   * Arms a timeout event.  If it's already armed, it's re-armed.
+   *
+   * @param t The timeout event to arm.
+   * @param delay The delay after which it expires.  Delays longer than the
+   * span of the wheel (2^32 ticks) are shortened to it.
+   */
+  void arm( timeout_event *t, std::chrono::nanoseconds delay );
+
+  /**
+   * Cancels a timeout event, if armed.
+   *
+   * @param t The timeout event to cancel.
+   */
+  void cancel( timeout_event *t );
+
+  /**
+   * Cancels a timeout event, if armed, and also waits until the wheel is no
+   * longer either posting it or running its machine so that it may be
+   * destroyed.
+   *
+   * @param t The timeout event to remove.
+   * @note Since this may wait for the wheel to run its machine, a machine
+   * must not be destroyed by a thread holding a mutex that one of its own
+   * actions may need.
+   */
+  void remove( timeout_event *t );
+
+  /**
+   * Expires all timeouts whose expiry is at or before the current time of the
+   * installed clock by posting them to their machines.  A timeout whose
+   * machine's inbox is full is expired at the next tick instead.  While a
+   * clock other than real time is installed, the machines that have no
+   * executor are then run on the calling thread before returning.
+   *
+   * @return Returns the number of timeouts expired.
+   */
+  std::size_t expire();
+
+  /**
+   * Gets the time of the next tick at which there is something to do.
+   *
+   * @return Returns said time or `nanoseconds::max()` if no timeout is armed.
+   */
+  std::chrono::nanoseconds next_time();
+
+  /**
+   * Restarts the wheel at tick 0 of the installed clock.  This is called by
+   * clock::install() and must be called only while no timeout is armed.
+   */
+  void restart();
+
+private:
+  typedef std::chrono::duration<
+    std::int64_t,std::ratio<CHSM_TIMER_TICK_US,1000000>
+  > tick_duration;
+
+  static unsigned const LEVELS = 4;
+  static unsigned const SLOT_BITS = 8;
+  static unsigned const SLOTS = 1u << SLOT_BITS;
+  static unsigned const SLOT_MASK = SLOTS - 1;
+  static std::uint64_t const MAX_TICKS = (1ull << (LEVELS * SLOT_BITS)) - 1;
+  static std::uint64_t const NEVER = ~std::uint64_t{ 0 };
+
+  timeout_event          *slot_[ LEVELS ][ SLOTS ];
+  timeout_event          *due_;         ///< Expired, but not yet posted.
+  std::uint64_t           now_;         ///< Last tick processed.
+  std::uint64_t           wake_;        ///< Tick the thread is sleeping to.
+  std::size_t             armed_;       ///< Number of armed timeouts.
+  std::chrono::nanoseconds epoch_;      ///< Time of tick 0.
+  bool                    real_time_;   ///< Is no clock installed?
+
+  timeout_event          *posting_;     ///< Being posted, if any.
+  std::deque<machine*>    run_queue_;   ///< Machines having no executor.
+  machine                *running_;     ///< Machine being run, if any.
+  std::thread::id         running_on_;  ///< Thread running running_.
+  std::mutex              mutex_;       ///< Guards the data above.
+  std::condition_variable cv_;          ///< Signalled upon earlier arming.
+  std::condition_variable run_cv_;      ///< Signalled upon queueing a run.
+
+  /**
+   * Signalled whenever posting_ or running_ is reset so that remove() can
+   * stop waiting.
+   */
+  std::condition_variable done_cv_;
+
+  std::thread             thread_;      ///< The thread.
+  std::thread             runner_;      ///< Runs the machines in run_queue_.
+
+  timer_wheel();
+  ~timer_wheel() = delete;
+
+  /**
+   * Disarms a timeout event, if armed.  The mutex must be held.
+   *
+   * @param t The timeout event to disarm.
+   */
+  void disarm( timeout_event *t );
+
+  /**
+   * Processes the next tick: cascades the timeouts of higher levels' slots,
+   * if reached, and moves those of the level 0 slot to the due list.
+   */
+  void advance();
+
+  /**
+   * Processes all ticks up to and including the given one.  Ticks at which
+   * there is nothing to do are skipped.
+   *
+   * @param tick The tick to advance to.
+   */
+  void advance_to( std::uint64_t tick );
+
+  /**
+   * Cascades the timeouts in a slot into the lower levels.
+   *
+   * @param level The level of the slot.
+   * @param slot The index of the slot.
+   */
+  void cascade( unsigned level, unsigned slot );
+
+  /**
+   * Inserts a timeout event into the slot for its expiry.
+   *
+   * @param t The timeout event to insert.
+   */
+  void link( timeout_event *t );
+
+  /**
+   * Inserts a timeout event at the front of a list.
+   *
+   * @param head A pointer to the head of the list.
+   * @param t The timeout event to insert.
+   */
+  static void link( timeout_event **head, timeout_event *t );
+
+  /**
+   * Removes a timeout event from whatever list it's in.
+   *
+   * @param t The timeout event to remove.
+   */
+  static void unlink( timeout_event *t );
+
+  /**
+   * The main loop of the thread.
+   */
+  void main_loop();
+
+  /**
+   * The main loop of the runner thread.
+   */
+  void run_loop();
+
+  /**
+   * Runs each machine in the run queue until it's empty.
+   *
+   * @param lock The lock of the mutex: it's released while running each.
+   */
+  void run_queued( std::unique_lock<std::mutex> &lock );
+
+  /**
+   * Gets the next tick after the current one at which there is something to
+   * do: either a non-empty slot of level 0 is reached or a non-empty slot of
+   * a higher level is to be cascaded.  (The ticks of the latter are
+   * conservative: they may be the start of the next rotation of a level
+   * whose slots are all empty.)
+   *
+   * @return Returns said tick or `NEVER` if no timeout is armed.
+   */
+  std::uint64_t next_tick() const;
+
+  /**
+   * Gets the tick a given time is in.
+   *
+   * @param t The time.
+   * @return Returns said tick.
+   */
+  std::uint64_t tick_of( std::chrono::nanoseconds t ) const {
+    return std::chrono::duration_cast<tick_duration>( t - epoch_ ).count();
+  }
+
+  timer_wheel( timer_wheel const& ) = delete;
+  timer_wheel& operator=( timer_wheel const& ) = delete;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+} // namespace
+
+#endif /* chsm_timer_wheel_H */
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,156 @@
+/*
+**      CHSM Language System
+**      test/c++/bench/chsm_bench.h
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef chsm_bench_H
+#define chsm_bench_H
+
+/**
+ * @file
+ * The harness for the libchsm microbenchmarks.  Each benchmark is a program
+ * that includes this file (once) and calls chsm_bench() for each thing to
+ * measure.  Results are printed to standard output one per line in JSON so
+ * that they can be compared between releases, e.g.:
+ * @code
+ *  {"benchmark":"deep","broadcasts_per_sec":5123456,"ns_per_micro_step":195.2,"allocs_per_broadcast":0}
+ * @endcode
+ * If the run-time library was built with `CHSM_NO_METRICS`, micro-steps
+ * aren't counted and `ns_per_micro_step` is `null`.
+ *
+ * The minimum time to measure each for (in seconds) can be set via the
+ * `CHSM_BENCH_SECONDS` environment variable; the default is 0.25.
+ */
+
+// CHSM
+#include <chsm.h>
+
+// standard
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The number of calls to `operator new` so far.
+ */
+static std::uint64_t chsm_bench_allocs;
+
+//
+// Count every allocation.  This replaces the global operator new, so this
+// file must be included only once per program.
+//
+void* operator new( std::size_t size ) {
+  ++chsm_bench_allocs;
+  if ( void *const p = std::malloc( size != 0 ? size : 1 ) )
+    return p;
+  throw std::bad_alloc{};
+}
+
+void operator delete( void *p ) noexcept {
+  std::free( p );
+}
+
+void operator delete( void *p, std::size_t ) noexcept {
+  std::free( p );
+}
+
+/**
+ * Gets the number of micro-steps a machine has performed so far.
+ *
+ * @param m The machine.
+ * @return Returns said number or 0 if metrics are compiled out.
+ */
+inline std::uint64_t chsm_bench_micro_steps( CHSM::machine const &m ) {
+#ifndef CHSM_NO_METRICS
+  return m.metrics().micro_steps_;
+#else
+  (void)m;
+  return 0;
+#endif /* CHSM_NO_METRICS */
+}
+
+/**
+ * Measures how long it takes to do some number of broadcasts to a machine and
+ * prints the result.
+ *
+ * @tparam BroadcastFn The type of \a broadcast.
+ * @param name The name of the benchmark.
+ * @param m The machine broadcast to.  It must have been entered.
+ * @param broadcast The function that does the broadcasts.  It's called
+ * repeatedly; each call must leave \a m in the configuration it found it in.
+ * @param broadcasts_per_call The number of broadcasts each call does.
+ */
+template<class BroadcastFn>
+void chsm_bench( char const *name, CHSM::machine &m, BroadcastFn broadcast,
+                 unsigned broadcasts_per_call = 1 ) {
+  typedef std::chrono::steady_clock clock;
+
+  double min_seconds = 0.25;
+  if ( char const *const s = std::getenv( "CHSM_BENCH_SECONDS" ) )
+    min_seconds = std::atof( s );
+
+  for ( unsigned i = 0; i < 1000; ++i )   // warm up
+    broadcast();
+
+  std::uint64_t calls = 1000;
+  for ( ;; ) {
+    //
+    // Getting the micro-steps allocates, so do it outside of counting.
+    //
+    std::uint64_t const micro_steps = chsm_bench_micro_steps( m );
+    std::uint64_t const allocs_before = chsm_bench_allocs;
+    clock::time_point const start = clock::now();
+    for ( std::uint64_t i = 0; i < calls; ++i )
+      broadcast();
+    double const seconds =
+      std::chrono::duration<double>( clock::now() - start ).count();
+    std::uint64_t const allocs = chsm_bench_allocs - allocs_before;
+
+    if ( seconds < min_seconds ) {
+      calls *= 2;
+      continue;
+    }
+
+    double const broadcasts = double( calls ) * broadcasts_per_call;
+    std::uint64_t const steps = chsm_bench_micro_steps( m ) - micro_steps;
+    std::printf(
+      "{\"benchmark\":\"%s\",\"broadcasts_per_sec\":%.0f,", name,
+      broadcasts / seconds
+    );
+    if ( steps != 0 )
+      std::printf( "\"ns_per_micro_step\":%.1f,", seconds * 1e9 / steps );
+    else
+      std::printf( "\"ns_per_micro_step\":null," );
+    std::printf(
+      "\"allocs_per_broadcast\":%.3f}\n",
+      allocs / broadcasts
+    );
+    std::fflush( stdout );
+    return;
+  } // for
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#endif /* chsm_bench_H */
+// vim:set et sw=2 ts=2:
@@ -0,0 +1,415 @@
+/*
+**      CHSM Language System
+**      test/c++/chsmgen.cpp
+**
+**      Copyright (C) 1996-2018  Paul J. Lucas & Fabio Riccardi
+**
+**      This program is free software; you can redistribute it and/or modify
+**      it under the terms of the GNU General Public License as published by
+**      the Free Software Foundation; either version 3 of the License, or
+**      (at your option) any later version.
+** 
+**      This program is distributed in the hope that it will be useful,
+**      but WITHOUT ANY WARRANTY; without even the implied warranty of
+**      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**      GNU General Public License for more details.
+** 
+**      You should have received a copy of the GNU General Public License
+**      along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file
+ * Generates a synthetic CHSM description for finding scaling cliffs in chsmc
+ * and libchsm.  The shape of the machine -- its number of states, nesting
+ * depth, mix of clusters and sets, use of history, number of transitions per
+ * event, event inheritance depth, and number of parameters per event -- is
+ * controlled by options.  The same options (including the seed) always
+ * generate the same machine.  The machine's main() enters it and broadcasts
+ * its events round-robin.
+ */
+
+// standard
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>                     /* for getopt(3) */
+#include <vector>
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * The kinds of state.
+ */
+enum class kind { STATE, CLUSTER, SET };
+
+/**
+ * A state in the tree of states being generated.
+ */
+struct node {
+  int         parent_;                  ///< Index of parent; -1 = root.
+  unsigned    depth_;                   ///< 1 = a child of the root.
+  vector<int> children_;
+  kind        kind_;
+  unsigned    history_;                 ///< 0 = none; 1 = history; 2 = deep.
+  string      transitions_;             ///< Already formatted.
+};
+
+static char const  *me;
+
+// options
+static unsigned     opt_broadcasts  = 1000;
+static unsigned     opt_depth       = 4;
+static unsigned     opt_events      = 8;
+static unsigned     opt_history_pct = 10;
+static unsigned     opt_inherit     = 0;
+static char const  *opt_name        = "gen_machine";
+static unsigned     opt_params      = 0;
+static unsigned     opt_seed        = 1;
+static unsigned     opt_set_pct     = 20;
+static unsigned     opt_states      = 100;
+static unsigned     opt_transitions = 4;
+
+static vector<node> nodes;
+static mt19937      rng;
+
+////////// local functions ////////////////////////////////////////////////////
+
+/**
+ * Gets a pseudo-random number.  (The distributions of the standard library
+ * aren't used since they're allowed to differ between implementations.)
+ *
+ * @param n The number of possible values.
+ * @return Returns a number in [0,n).
+ */
+static unsigned random( unsigned n ) {
+  return static_cast<unsigned>( rng() % n );
+}
+
+/**
+ * Gets the name of a state.
+ *
+ * @param i The index of the state.
+ * @return Returns said name.
+ */
+static string state_name( int i ) {
+  return 's' + to_string( i );
+}
+
+/**
+ * Gets the name of an event.
+ *
+ * @param j The index of the event.
+ * @return Returns said name.
+ */
+static string event_name( unsigned j ) {
+  return 'e' + to_string( j );
+}
+
+/**
+ * Gets the name of a state as referred to from within the scope of another.
+ * The name is fully qualified and preceded by one period per scope to back
+ * up to get to the root's scope.
+ *
+ * @param i The index of the state.
+ * @param from The index of the state whose scope the name is in.
+ * @return Returns said name.
+ */
+static string name_from( int i, int from ) {
+  string name = state_name( i );
+  while ( (i = nodes[ i ].parent_) != -1 )
+    name = state_name( i ) + '.' + name;
+  return string( nodes[ from ].depth_ - 1, '.' ) + name;
+}
+
+/**
+ * Checks whether one state is the same as or an ancestor of another.
+ *
+ * @param a The index of the would-be ancestor state.
+ * @param d The index of the would-be descendant state.
+ * @return Returns \c true only if \a a is \a d or one of its ancestors.
+ */
+static bool is_ancestor_of( int a, int d ) {
+  for ( ; d != -1; d = nodes[ d ].parent_ )
+    if ( d == a )
+      return true;
+  return false;
+}
+
+/**
+ * Checks whether a transition between two states is legal, i.e., isn't
+ * between the children of a set.
+ *
+ * @param from The index of the source state.
+ * @param to The index of the target state.
+ * @return Returns \c true only if the transition is legal.
+ */
+static bool is_legal( int from, int to ) {
+  if ( is_ancestor_of( from, to ) || is_ancestor_of( to, from ) )
+    return true;
+  int lca = nodes[ from ].parent_;
+  while ( lca != -1 && !is_ancestor_of( lca, to ) )
+    lca = nodes[ lca ].parent_;
+  return lca == -1 || nodes[ lca ].kind_ != kind::SET;
+}
+
+/**
+ * Gets the inheritance level of an event.
+ *
+ * @param j The index of the event.
+ * @return Returns 0 for an event having no base event, 1 for an event
+ * derived from one, and so on.
+ */
+static unsigned level_of( unsigned j ) {
+  return j % (opt_inherit + 1);
+}
+
+/**
+ * Generates the tree of states.  A chain of states nested \c opt_depth deep
+ * is generated first so that the maximum depth is always reached; the
+ * remaining states are then added as children of random states that aren't
+ * already at the maximum depth.
+ */
+static void generate_states() {
+  unsigned const depth = min( opt_depth, opt_states );
+  for ( unsigned i = 0; i < opt_states; ++i ) {
+    int parent;
+    if ( i < depth )
+      parent = static_cast<int>( i ) - 1;
+    else {
+      parent = static_cast<int>( random( i + 1 ) ) - 1;
+      while ( parent != -1 && nodes[ parent ].depth_ >= depth )
+        parent = nodes[ parent ].parent_;
+    }
+    node n;
+    n.parent_ = parent;
+    n.depth_ = parent == -1 ? 1 : nodes[ parent ].depth_ + 1;
+    n.kind_ = kind::STATE;
+    n.history_ = 0;
+    nodes.push_back( n );
+    if ( parent != -1 )
+      nodes[ parent ].children_.push_back( static_cast<int>( i ) );
+  } // for
+
+  for ( node &n : nodes ) {
+    if ( n.children_.empty() )
+      continue;
+    if ( random( 100 ) < opt_set_pct )
+      n.kind_ = kind::SET;
+    else {
+      n.kind_ = kind::CLUSTER;
+      if ( random( 100 ) < opt_history_pct )
+        n.history_ = 1 + random( 2 );
+    }
+  } // for
+}
+
+/**
+ * Generates the transitions.  Each event has \c opt_transitions transitions
+ * from random states to random states.  If events have parameters, half the
+ * transitions have a condition on one.
+ */
+static void generate_transitions() {
+  for ( unsigned j = 0; j < opt_events; ++j ) {
+    string const event = event_name( j );
+    for ( unsigned t = 0; t < opt_transitions; ++t ) {
+      int const from = static_cast<int>( random( opt_states ) );
+      int to;
+      unsigned tries = 0;
+      do {
+        to = static_cast<int>( random( opt_states ) );
+      } while ( !is_legal( from, to ) && ++tries < 8 );
+      if ( !is_legal( from, to ) )
+        to = from;
+
+      string &s = nodes[ from ].transitions_;
+      s += ' ' + event;
+      if ( opt_params > 0 && random( 2 ) )
+        s += "[ " + event + "->" + event + "_0 % 3 != 0 ]";
+      s += " -> " + name_from( to, from ) + ';';
+    } // for
+  } // for
+}
+
+/**
+ * Emits a state and, if it's a parent, its child states.
+ *
+ * @param i The index of the state.
+ */
+static void emit_state( int i ) {
+  node const &n = nodes[ i ];
+  string const indent( 2 * n.depth_, ' ' );
+
+  cout << indent;
+  switch ( n.kind_ ) {
+    case kind::STATE  : cout << "state ";   break;
+    case kind::CLUSTER: cout << "cluster "; break;
+    case kind::SET    : cout << "set ";     break;
+  } // switch
+  cout << state_name( i );
+
+  if ( n.kind_ != kind::STATE ) {
+    char sep = '(';
+    for ( int child : n.children_ ) {
+      cout << sep << state_name( child );
+      sep = ',';
+    } // for
+    cout << ')';
+    if ( n.history_ != 0 )
+      cout << (n.history_ == 2 ? " deep" : "") << " history";
+  }
+
+  if ( !n.transitions_.empty() )
+    cout << " {" << n.transitions_ << " }";
+  else if ( n.kind_ == kind::STATE )
+    cout << ';';
+
+  if ( n.kind_ != kind::STATE ) {
+    cout << " is {\n";
+    for ( int child : n.children_ )
+      emit_state( child );
+    cout << indent << '}';
+  }
+  cout << '\n';
+}
+
+/**
+ * Emits the CHSM description.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The command-line arguments.
+ */
+static void emit( int argc, char const *argv[] ) {
+  cout << "// Generated by:";
+  for ( int i = 0; i < argc; ++i )
+    cout << ' ' << argv[i];
+  cout << "\n\n"
+          "%%\n\n"
+          "chsm " << opt_name << " is {\n";
+
+  for ( unsigned j = 0; j < opt_events; ++j ) {
+    cout << "  event";
+    if ( level_of( j ) > 0 )
+      cout << '<' << event_name( j - 1 ) << '>';
+    cout << ' ' << event_name( j );
+    if ( opt_params > 0 ) {
+      char sep = '(';
+      for ( unsigned k = 0; k < opt_params; ++k ) {
+        cout << sep << " int " << event_name( j ) << '_' << k;
+        sep = ',';
+      } // for
+      cout << " )";
+    }
+    cout << ";\n";
+  } // for
+
+  for ( unsigned i = 0; i < opt_states; ++i )
+    if ( nodes[ i ].parent_ == -1 )
+      emit_state( static_cast<int>( i ) );
+
+  cout << "}\n"
+          "\n"
+          "%%\n"
+          "\n"
+          "int main() {\n"
+          "  " << opt_name << " m;\n"
+          "  m.enter();\n"
+          "  for ( int i = 0; i < " << opt_broadcasts << "; ++i ) {\n"
+          "    switch ( i % " << opt_events << " ) {\n";
+
+  for ( unsigned j = 0; j < opt_events; ++j ) {
+    cout << "      case " << j << ": m." << event_name( j ) << '(';
+    unsigned const args = opt_params * (level_of( j ) + 1);
+    for ( unsigned k = 0; k < args; ++k )
+      cout << (k ? ", " : " ") << "i + " << k << (k + 1 == args ? " " : "");
+    cout << "); break;\n";
+  } // for
+
+  cout << "    } // switch\n"
+          "  } // for\n"
+          "  return m.active() ? 0 : 1;\n"
+          "}\n";
+}
+
+/**
+ * Parses a non-negative integer option argument.
+ *
+ * @param opt The option.
+ * @param max The maximum value.
+ * @return Returns said integer.
+ */
+static unsigned parse_unsigned( char opt, unsigned max ) {
+  char *end;
+  unsigned long const n = ::strtoul( ::optarg, &end, 10 );
+  if ( *::optarg == '\0' || *end != '\0' || *::optarg == '-' || n > max ) {
+    cerr << me << ": \"" << ::optarg << "\": invalid value for -" << opt
+         << "; must be in [0," << max << "]\n";
+    ::exit( EXIT_FAILURE );
+  }
+  return static_cast<unsigned>( n );
+}
+
+/**
+ * Prints the usage message and exits.
+ */
+static void usage() {
+  cerr <<
+"usage: " << me << " [options] > file.chsmc\n"
+"options:\n"
+"  -b n  Number of events main() broadcasts [default: 1000].\n"
+"  -d n  Maximum nesting depth of states [default: 4].\n"
+"  -e n  Number of events [default: 8].\n"
+"  -H n  Percent of clusters having a history [default: 10].\n"
+"  -i n  Event inheritance depth [default: 0].\n"
+"  -n s  Name of the machine [default: gen_machine].\n"
+"  -p n  Number of parameters per event [default: 0].\n"
+"  -r n  Seed for the random number generator [default: 1].\n"
+"  -S n  Percent of parent states that are sets [default: 20].\n"
+"  -s n  Number of states, including parents [default: 100].\n"
+"  -t n  Number of transitions per event [default: 4].\n"
+  ;
+  ::exit( EXIT_FAILURE );
+}
+
+////////// main ///////////////////////////////////////////////////////////////
+
+int main( int argc, char const *argv[] ) {
+  me = argv[0];
+  unsigned const MAX = 1000000;
+  for (;;) {
+    int const opt = ::getopt(
+      argc, const_cast<char**>( argv ), "b:d:e:H:i:n:p:r:S:s:t:"
+    );
+    if ( opt == -1 )
+      break;
+    switch ( opt ) {
+      case 'b': opt_broadcasts  = parse_unsigned( 'b', MAX );     break;
+      case 'd': opt_depth       = parse_unsigned( 'd', MAX );     break;
+      case 'e': opt_events      = parse_unsigned( 'e', MAX );     break;
+      case 'H': opt_history_pct = parse_unsigned( 'H', 100 );     break;
+      case 'i': opt_inherit     = parse_unsigned( 'i', MAX );     break;
+      case 'n': opt_name        = ::optarg;                       break;
+      case 'p': opt_params      = parse_unsigned( 'p', MAX );     break;
+      case 'r': opt_seed        = parse_unsigned( 'r', ~0u );     break;
+      case 'S': opt_set_pct     = parse_unsigned( 'S', 100 );     break;
+      case 's': opt_states      = parse_unsigned( 's', MAX );     break;
+      case 't': opt_transitions = parse_unsigned( 't', MAX );     break;
+      default : usage();
+    } // switch
+  } // for
+  if ( ::optind != argc || opt_states == 0 || opt_events == 0 ||
+       opt_depth == 0 ) {
+    usage();
+  }
+
+  rng.seed( opt_seed );
+  generate_states();
+  generate_transitions();
+  emit( argc, argv );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/* vim:set et sw=2 ts=2: */